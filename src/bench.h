@@ -0,0 +1,187 @@
+// Shared part of the benchmarks. Every src/bench_*.c is a program of its
+// own that `make bench` builds and runs. Each includes the whole editor the
+// way main.c is built, times something on generated text and exits with 1
+// when one of its checks fails. An optional argument sets the size of that
+// text in MB.
+//
+// No window is opened, so the texture and drawing calls the editor makes
+// are replaced by ones that keep textures in memory and record the last
+// quad drawn.
+
+#include <time.h>
+#include <unistd.h>
+
+#define LoadTextureFromImage bench_load_texture
+#define UpdateTextureRec bench_update_texture
+#define UnloadTexture bench_unload_texture
+#define DrawTexturePro bench_draw_texture
+#define DrawRectangle bench_draw_rectangle
+#define rlDrawRenderBatchActive bench_flush
+#define GetScreenWidth bench_screen_width
+#define GetScreenHeight bench_screen_height
+#define main txt_main
+#include "main.c"
+#undef main
+
+// GRAY_ALPHA pixels of the textures by id, 0 is never used. Ids of
+// unloaded textures are given out again.
+#define BENCH_TEXTURES 64
+unsigned char* bench_textures[BENCH_TEXTURES];
+
+// The last quad drawn, and how many there were. Every quad is also pushed
+// to BENCH_RECORD while it isn't null.
+typedef struct {
+    Texture2D texture;
+    Rectangle src;
+    Rectangle dst;
+    Color tint;
+} BenchQuad;
+
+BenchQuad bench_quad;
+size_t bench_quads;
+BenchQuad* bench_record;
+size_t bench_flushes;
+int bench_width = 1280;
+int bench_height = 800;
+bool bench_failed;
+
+Texture2D bench_load_texture(Image image) {
+    Texture2D texture = {0};
+    int id = 1;
+    while (id < BENCH_TEXTURES && bench_textures[id]) id++;
+    if (id == BENCH_TEXTURES) return texture;
+    bench_textures[id] = calloc(image.width*image.height, 2);
+    if (image.data && image.format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA) {
+        memcpy(bench_textures[id], image.data, image.width*image.height*2);
+    }
+    texture = (Texture2D) {id, image.width, image.height, 1, image.format};
+    return texture;
+}
+
+void bench_update_texture(Texture2D texture, Rectangle rec, const void* pixels) {
+    const unsigned char* p = pixels;
+    for (int y = 0; y < rec.height; ++y) {
+        unsigned char* row = bench_textures[texture.id] + 2*((int) (rec.y + y)*texture.width + (int) rec.x);
+        memcpy(row, p + 2*y*(int) rec.width, 2*(int) rec.width);
+    }
+}
+
+void bench_unload_texture(Texture2D texture) {
+    free(bench_textures[texture.id]);
+    bench_textures[texture.id] = 0;
+}
+
+void bench_draw_texture(Texture2D texture, Rectangle src, Rectangle dst, Vector2 origin, float rotation, Color tint) {
+    (void) origin;
+    (void) rotation;
+    bench_quad = (BenchQuad) {texture, src, dst, tint};
+    bench_quads++;
+    if (bench_record) da_push(bench_record, bench_quad);
+}
+
+void bench_draw_rectangle(int x, int y, int width, int height, Color color) {
+    (void) x;
+    (void) y;
+    (void) width;
+    (void) height;
+    (void) color;
+}
+
+void bench_flush(void) {
+    bench_flushes++;
+}
+
+int bench_screen_width(void) {
+    return bench_width;
+}
+
+int bench_screen_height(void) {
+    return bench_height;
+}
+
+// Milliseconds on a monotonic clock.
+double bench_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1e3 + t.tv_nsec/1e6;
+}
+
+// Bytes of text to run on, MB megabytes unless the command line says.
+size_t bench_size(int argc, char** argv, size_t mb) {
+    if (argc > 1 && atoi(argv[1]) > 0) mb = atoi(argv[1]);
+    return mb*1024*1024;
+}
+
+void bench_check(bool ok, const char* what) {
+    printf("  %-48s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) bench_failed = true;
+}
+
+// BYTES of malloc'd UTF-8 in lines of up to 120 codepoints, mostly ASCII
+// words with some two, three and four byte codepoints.
+char* bench_text(size_t bytes, unsigned int seed) {
+    static const char* words[] = {
+        "int", "buffer", "x", "return", "0x1F", "{", "}", "(a, b);", "// note", "\"str\"",
+        "café", "жизнь", "中文", "😀", "naïve", "->", "=", "while", "size_t", "\t",
+    };
+    char* text = malloc(bytes + 1);
+    srand(seed);
+    size_t at = 0, line = 0, limit = rand() % 120;
+    while (at < bytes) {
+        if (line >= limit) {
+            text[at++] = '\n';
+            line = 0;
+            limit = rand() % 120;
+            continue;
+        }
+        const char* word = words[rand() % (sizeof(words)/sizeof(*words))];
+        size_t n = strlen(word);
+        if (at + n + 1 > bytes) break;
+        memcpy(text + at, word, n);
+        at += n;
+        text[at++] = ' ';
+        line += n + 1;
+    }
+    while (at < bytes) text[at++] = '\n';
+    text[bytes] = '\0';
+    return text;
+}
+
+// The default token colors and language definitions, without the config
+// directory.
+void bench_languages(void) {
+    SetTraceLogLevel(LOG_NONE);
+    text_select_kernel();
+    DEFAULT      = (Color){255, 255, 255, 255};
+    COMMENT      = (Color){190, 255, 181, 255};
+    NUMBER       = (Color){181, 219, 255, 255};
+    KWORD        = (Color){252, 237, 162, 255};
+    STRING       = (Color){252, 167, 162, 255};
+    ERROR        = (Color){255, 0,   0,   255};
+    PREPROCESSOR = (Color){218, 181, 255, 255};
+#ifdef TEXT_SIMD
+    __builtin_cpu_init();
+    lang_avx2 = __builtin_cpu_supports("avx2");
+    lang_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+    languages = da_new(Language);
+    for (size_t i = 0; i < sizeof(default_languages)/sizeof(*default_languages); ++i) {
+        char* source = strdup(default_languages[i][1]);
+        Language lang;
+        if (lang_compile(&lang, source)) da_push(languages, lang);
+        free(source);
+    }
+    HL_MARGIN = 100;
+}
+
+// A buffer named NAME holding the malloc'd TEXT, which it takes.
+void bench_buffer(Buffer* buf, const char* name, char* text, size_t bytes) {
+    memset(buf, 0, sizeof(Buffer));
+    init_buf(buf);
+    text_free(&buf->text);
+    text_init_from(&buf->text, text, bytes);
+    int length;
+    buf->filename = LoadCodepoints(name, &length);
+    buf->filenamel = length;
+    color_highlight(buf);
+}
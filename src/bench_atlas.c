@@ -0,0 +1,81 @@
+// The glyph atlas under more distinct glyphs than it has cells for. Every
+// quad drawn has to sample exactly a fresh rasterization of its codepoint,
+// evicted glyphs included. Cells and glyphs have to keep pointing at each
+// other, and the batch has to be flushed before a cell is reused.
+
+#include "bench.h"
+
+#define BENCH_SIZE 24
+
+// Whether the last quad drawn shows codepoint C.
+bool drew(Glyphs* g, int c) {
+    GlyphInfo* info = LoadFontData(g->ttf, g->ttf_size, g->size, &c, 1, FONT_DEFAULT);
+    Image image = info[0].image;
+    int side = g->cell_size - 2*GLYPH_PAD;
+    int width = image.data && image.width < side ? image.width : image.data ? side : 0;
+    int height = image.data && image.height < side ? image.height : image.data ? side : 0;
+    const unsigned char* gray = image.data;
+    const unsigned char* pixels = bench_textures[bench_quad.texture.id];
+    Rectangle src = bench_quad.src;
+    bool same = src.width == width + 2*GLYPH_PAD && src.height == height + 2*GLYPH_PAD;
+    for (int y = 0; y < src.height && same; ++y) {
+        for (int x = 0; x < src.width; ++x) {
+            int gx = x - GLYPH_PAD, gy = y - GLYPH_PAD;
+            int want = gx >= 0 && gy >= 0 && gx < width && gy < height ? gray[gy*image.width + gx] : 0;
+            int got = pixels[2*((int) (src.y + y)*bench_quad.texture.width + (int) (src.x + x)) + 1];
+            same = same && got == want;
+        }
+    }
+    UnloadFontData(info, 1);
+    return same;
+}
+
+int main(void) {
+    bench_languages();
+    printf("glyph atlas\n");
+
+    int old[512] = {0};
+    for (int i = 0; i < 95; i++) old[i] = 32 + i;
+    for (int i = 0; i < 255; i++) old[96 + i] = 0x400 + i;
+    double t0 = bench_now();
+    GlyphInfo* info = LoadFontData(__FONT_TTF, __FONT_TTF_LENGTH, BENCH_SIZE, old, 512, FONT_DEFAULT);
+    Rectangle* recs;
+    Image atlas = GenImageFontAtlas(info, &recs, 512, BENCH_SIZE, 4, 0);
+    ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+    double t1 = bench_now();
+    Glyphs g = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, BENCH_SIZE);
+    double t2 = bench_now();
+    printf("  startup: baking 512 glyphs %.2f ms, glyphs_init %.2f ms\n", t1 - t0, t2 - t1);
+    UnloadImage(atlas);
+    UnloadFontData(info, 512);
+    free(recs);
+
+    int capacity = GLYPH_ATLAS_PAGES*g.cells_per_atlas;
+    int draws = 0, wrong = 0;
+    srand(23);
+    for (int frame = 0; frame < 40; ++frame) {
+        for (int k = 0; k < 200; ++k) {
+            int c = rand() % 3 ? 0x4E00 + rand() % 3000 : 0x20 + rand() % 95;
+            if (rand() % 50 == 0) c = 0x1F300 + rand() % 500;
+            if (c == ' ') continue;
+            glyph_draw(&g, c, (Vector2) {0, 0}, WHITE);
+            draws++;
+            wrong += !drew(&g, c);
+        }
+    }
+    printf("  %d draws of %zu glyphs into %d cells\n", draws, da_length(g.glyphs), capacity);
+    bench_check(da_length(g.glyphs) > (size_t) capacity, "more glyphs than cells");
+    bench_check(wrong == 0, "every quad samples its own bitmap");
+    // Each placement flushes the batch before overwriting a cell.
+    bench_check(bench_flushes >= da_length(g.glyphs), "the batch is flushed before each placement");
+
+    int broken = 0;
+    for (int k = 0; k < g.cell_count; ++k) broken += g.glyphs[g.cells[k].glyph].cell != k;
+    for (size_t i = 0; i < da_length(g.glyphs); ++i) {
+        if (g.glyphs[i].cell >= 0) broken += g.cells[g.glyphs[i].cell].glyph != (int) i;
+        broken += glyph_find(&g, g.glyphs[i].codepoint) != (int) i;
+    }
+    bench_check(broken == 0 && g.atlas_count <= GLYPH_ATLAS_PAGES, "cells, glyphs and lookups agree");
+    glyphs_unload(&g);
+    return bench_failed;
+}
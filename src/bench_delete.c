@@ -0,0 +1,94 @@
+// Random selection deletes on a 500 MB buffer, some of them a tenth of it
+// long. The same deletes on a small buffer are checked against a flat
+// array, along with where the cursor and the selection origin end up.
+
+#include "bench.h"
+
+#define BENCH_DELETES 2000
+
+// Codepoint offset P after [START, END) was removed.
+size_t deleted(size_t p, size_t start, size_t end) {
+    if (p >= end) return p - (end - start);
+    if (p > start) return start;
+    return p;
+}
+
+// Makes BENCH_DELETES selections in BUF and removes them. When MODEL isn't
+// null it holds the same text as codepoints and gets the same deletes.
+// Returns false when the buffer and the model disagree.
+bool run(Buffer* buf, size_t longest, int* model, double* time) {
+    srand(11);
+    bool same = true;
+    for (int d = 0; d < BENCH_DELETES && same; ++d) {
+        size_t length = text_length(&buf->text);
+        if (length == 0) break;
+        size_t span = rand() % 20 == 0 ? (size_t) rand()*rand() % longest : (size_t) rand() % 100;
+        size_t start = (size_t) rand()*rand() % length;
+        size_t end = start + span < length ? start + span : length;
+        size_t other = (size_t) rand()*rand() % length;
+        if (rand() % 2) {
+            buf->cursor = start;
+            buf_select(buf, end);
+        } else {
+            buf->cursor = end;
+            buf_select(buf, start);
+        }
+
+        size_t origin = buf->selection_origin;
+        double t0 = bench_now();
+        if (d % 2) {
+            remove_selection(buf);
+        } else {
+            // A delete that leaves the selection elsewhere behind.
+            buf->cursor = other;
+            delete_range(buf, start, end);
+        }
+        *time += bench_now() - t0;
+
+        same = text_length(&buf->text) == length - (end - start);
+        if (d % 2) {
+            same = same && buf->cursor == start && !buf->has_selection;
+        } else {
+            same = same && buf->cursor == deleted(other, start, end);
+            same = same && buf->has_selection && buf->selection_origin == deleted(origin, start, end);
+        }
+        if (model) {
+            memmove(model + start, model + end, (length - end)*sizeof(int));
+            int* out = malloc((length - (end - start))*sizeof(int));
+            size_t copied = text_copy(&buf->text, 0, text_length(&buf->text), out);
+            same = same && copied == length - (end - start) && memcmp(out, model, copied*sizeof(int)) == 0;
+            free(out);
+        }
+    }
+    return same;
+}
+
+int main(int argc, char** argv) {
+    size_t n = bench_size(argc, argv, 500);
+    bench_languages();
+    printf("delete_range, %zu MB\n", n >> 20);
+
+    Buffer small;
+    size_t small_bytes = 256*1024;
+    char* text = bench_text(small_bytes, 12);
+    int* model = malloc(small_bytes*sizeof(int));
+    for (size_t i = 0, k = 0; i < small_bytes; ++k) {
+        int size;
+        model[k] = text_utf8_decode(text + i, small_bytes - i, &size);
+        i += size;
+    }
+    bench_buffer(&small, "bench.txt", text, small_bytes);
+    double time = 0;
+    bench_check(run(&small, text_length(&small.text)/10, model, &time), "deletes match an array");
+    deinit_buf(&small);
+    free(model);
+
+    Buffer big;
+    bench_buffer(&big, "bench.txt", bench_text(n, 13), n);
+    time = 0;
+    bool ok = run(&big, text_length(&big.text)/10, 0, &time);
+    printf("  %d deletes: %.1f ms in total, %.2f us each\n", BENCH_DELETES, time, time*1e3/BENCH_DELETES);
+    bench_check(ok, "lengths, cursor and selection");
+    deinit_buf(&big);
+    return bench_failed;
+}
@@ -0,0 +1,105 @@
+// draw_text against glyph positions and colors worked out the slow way:
+// advances and offsets from a raylib font of the same TTF, and the color of
+// each column from a search through all of the line's tokens.
+
+#include "bench.h"
+
+typedef struct {
+    Font font;
+    int* codepoints;
+} Reference;
+
+// A raylib font with every codepoint of the N bytes at TEXT.
+Reference reference_font(const char* text, size_t n, int size) {
+    Reference r = {{0}, da_new(int)};
+    for (int c = 32; c < 127; ++c) da_push(r.codepoints, c);
+    for (size_t i = 0; i < n;) {
+        int length;
+        int c = text_utf8_decode(text + i, n - i, &length);
+        i += length;
+        bool known = c < 127;
+        for (size_t k = 95; k < da_length(r.codepoints) && !known; ++k) known = r.codepoints[k] == c;
+        if (!known) da_push(r.codepoints, c);
+    }
+    int count = da_length(r.codepoints);
+    r.font.baseSize = size;
+    r.font.glyphCount = count;
+    r.font.glyphPadding = 4;
+    r.font.glyphs = LoadFontData(__FONT_TTF, __FONT_TTF_LENGTH, size, r.codepoints, count, FONT_DEFAULT);
+    UnloadImage(GenImageFontAtlas(r.font.glyphs, &r.font.recs, count, size, 4, 0));
+    return r;
+}
+
+// The quads draw_text should make for line L of BUF from X, Y.
+BenchQuad* reference_draw(Buffer* buf, Font font, size_t l, float x, float y) {
+    BenchQuad* quads = da_new(BenchQuad);
+    Line line = buf_line(buf, l);
+    size_t count = 0;
+    Token* tokens = buf_line_tokens(buf, l, &count);
+    int* content = malloc((line.end - line.start + 1)*sizeof(int));
+    size_t length = text_copy(&buf->text, line.start, line.end, content);
+    for (size_t col = 0; col < length; ++col) {
+        Color color = DEFAULT;
+        for (size_t t = 0; t < count; ++t) {
+            if (tokens[t].start <= col && col < (size_t) tokens[t].start + tokens[t].length) color = *PALETTE[tokens[t].class];
+        }
+        int c = content[col];
+        GlyphInfo glyph = font.glyphs[GetGlyphIndex(font, c)];
+        if (c != ' ' && c != '\t') {
+            Rectangle dst = {x + glyph.offsetX - GLYPH_PAD, y + glyph.offsetY - GLYPH_PAD, 0, 0};
+            da_push(quads, ((BenchQuad) {.dst = dst, .tint = color}));
+        }
+        x += glyph.advanceX ? glyph.advanceX : font.recs[GetGlyphIndex(font, c)].width + glyph.offsetX;
+        if (x > GetScreenWidth()) break;
+    }
+    free(content);
+    return quads;
+}
+
+bool same_quads(BenchQuad* a, BenchQuad* b) {
+    if (da_length(a) != da_length(b)) return false;
+    for (size_t i = 0; i < da_length(a); ++i) {
+        if (a[i].dst.x != b[i].dst.x || a[i].dst.y != b[i].dst.y) return false;
+        if (memcmp(&a[i].tint, &b[i].tint, sizeof(Color)) != 0) return false;
+    }
+    return true;
+}
+
+int main(void) {
+    bench_languages();
+    size_t n = 1024*1024;
+    char* text = bench_text(n, 21);
+    Reference reference = reference_font(text, n, 24);
+    Glyphs glyphs = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, 24);
+    Buffer buf;
+    bench_buffer(&buf, "bench.c", text, n);
+    size_t lines = buf_line_count(&buf);
+    while (color_highlight_update(&buf, 0, lines)) usleep(1000);
+    printf("draw_text against a per-codepoint reference, %zu lines\n", lines);
+
+    for (int wide = 0; wide < 2; ++wide) {
+        // Narrow windows cut lines off at the right edge.
+        bench_width = wide ? 100000 : 400;
+        int wrong = 0;
+        for (size_t l = 0; l < lines; ++l) {
+            bench_record = da_new(BenchQuad);
+            draw_text(&buf, buf_line(&buf, l), &glyphs, 88, 10, -3, l);
+            BenchQuad* expected = reference_draw(&buf, reference.font, l, 85, 10);
+            wrong += !same_quads(bench_record, expected);
+            da_free(expected);
+            da_free(bench_record);
+            bench_record = 0;
+        }
+        bench_check(wrong == 0, TextFormat("positions and colors, %d px window", bench_width));
+    }
+
+    bench_width = 1280;
+    double t0 = bench_now();
+    for (int r = 0; r < 2000; ++r) {
+        for (size_t l = 0; l < 50; ++l) draw_text(&buf, buf_line(&buf, l), &glyphs, 88, 10, 0, l);
+    }
+    printf("  a 50 line frame: %.1f us\n", (bench_now() - t0)/2);
+    deinit_buf(&buf);
+    glyphs_unload(&glyphs);
+    return bench_failed;
+}
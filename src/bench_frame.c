@@ -0,0 +1,51 @@
+// Frame time against file size. A frame draws the lines in the window at
+// the top, middle and end of C files from 1 MB up to 1 GB, once the
+// highlighter has caught up there. It should not depend on the size. The
+// files are opened the way the editor opens them, so the big ones are
+// mapped.
+
+#include "bench.h"
+
+#define BENCH_FRAMES 200
+
+int main(int argc, char** argv) {
+    size_t largest = bench_size(argc, argv, 1024);
+    bench_languages();
+    Glyphs* glyphs = load_font(24);
+    printf("frame time by file size\n");
+
+    for (size_t n = 1024*1024; n <= largest; n *= 10) {
+        char* text = bench_text(n, 17);
+        const char* fname = "/tmp/txt_bench_frame.c";
+        FILE* f = fopen(fname, "w");
+        fwrite(text, 1, n, f);
+        fclose(f);
+        free(text);
+        Buffer buf = {0};
+        init_buf_from_file(&buf, (char*) fname);
+        while (buf_load_poll(&buf) || buf_index(&buf)) usleep(1000);
+        size_t lines = buf_line_count(&buf);
+        size_t at[3] = {0, lines/2, lines > 40 ? lines - 40 : 0};
+        double frame[3];
+        bool idle = true, colored = true;
+        for (int k = 0; k < 3; ++k) {
+            buf.cursor = text_line_start(&buf.text, at[k] + 5);
+            // The first frames post the lexing, wait for it to be done.
+            while (color_highlight_update(&buf, at[k], at[k] + 40)) usleep(1000);
+            colored = colored && buf.language != LANGUAGE_PLAIN && da_length(buf.tokens) > 0;
+            draw_buffer(&buf, glyphs, 24, at[k], 0, 80, 8, false, 2);
+            size_t posts = buf.highlighter->posts;
+            double t0 = bench_now();
+            for (int f = 0; f < BENCH_FRAMES; ++f) draw_buffer(&buf, glyphs, 24, at[k], 0, 80, 8, false, 2);
+            frame[k] = (bench_now() - t0)*1e3/BENCH_FRAMES;
+            idle = idle && !hl_poll(&buf) && buf.highlighter->posts == posts;
+        }
+        printf("  %5zu MB %-6s %9zu lines: top %6.1f us, middle %6.1f us, end %6.1f us\n",
+               n >> 20, buf.text.mapped ? "mapped" : "", lines, frame[0], frame[1], frame[2]);
+        bench_check(colored, TextFormat("highlighted at %zu MB", n >> 20));
+        bench_check(idle, TextFormat("no lexing on steady frames at %zu MB", n >> 20));
+        deinit_buf(&buf);
+        remove(fname);
+    }
+    return bench_failed;
+}
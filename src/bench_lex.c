@@ -0,0 +1,144 @@
+// The C lexer on the repo's own sources repeated up to 100 MB, with the
+// AVX2, SSSE3 and scalar token runs. All of them have to give the same
+// tokens, there and on random lines mixing ASCII with Latin-1, CJK and
+// ideographic spaces.
+
+#include "bench.h"
+
+#define BENCH_RANDOM_LINES 200000
+
+typedef struct {
+    int* content;
+    size_t* lines;
+    Token* tokens;
+} Lines;
+
+// Splits the N bytes of UTF-8 at TEXT into lines of codepoints.
+Lines split(const char* text, size_t n) {
+    Lines l = {malloc((n + 1)*sizeof(int)), da_new(size_t), 0};
+    size_t length = 0;
+    da_push(l.lines, length);
+    for (size_t i = 0; i < n;) {
+        int size;
+        int c = text_utf8_decode(text + i, n - i, &size);
+        i += size;
+        if (c == '\n') da_push(l.lines, length);
+        else l.content[length++] = c;
+    }
+    da_push(l.lines, length);
+    return l;
+}
+
+// Lexes every line of L into its tokens, returns the milliseconds it took.
+double lex(const Language* lang, Lines* l) {
+    if (l->tokens) da_free(l->tokens);
+    l->tokens = da_new(Token);
+    unsigned char state = 0;
+    double t0 = bench_now();
+    for (size_t i = 0; i + 1 < da_length(l->lines); ++i) {
+        size_t start = l->lines[i];
+        state = lang_highlight_line(lang, l->content + start, l->lines[i + 1] - start, state, &l->tokens);
+    }
+    return bench_now() - t0;
+}
+
+bool same_tokens(Token* a, Token* b) {
+    if (da_length(a) != da_length(b)) return false;
+    for (size_t i = 0; i < da_length(a); ++i) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length || a[i].class != b[i].class) return false;
+    }
+    return true;
+}
+
+// Runs of the lexer that can be picked on this machine, scalar first.
+int modes(bool* avx2, bool* ssse3, const char** names) {
+    int count = 0;
+    avx2[count] = ssse3[count] = false;
+    names[count++] = "scalar";
+#ifdef TEXT_SIMD
+    if (__builtin_cpu_supports("ssse3")) {
+        avx2[count] = false;
+        ssse3[count] = true;
+        names[count++] = "ssse3";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        avx2[count] = ssse3[count] = true;
+        names[count++] = "avx2";
+    }
+#endif
+    return count;
+}
+
+char* random_lines(size_t count) {
+    static const char* pieces[] = {
+        "int", " ", "x1", "_", "é", "ж", "中文", "\xE3\x80\x80", "//", "/*", "*/", "\"", "'", "\\",
+        "0x1F", "3.5", "#include", "<", ">", "(", ")", ";", "naïve", "ß", "×", "\t", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+    };
+    char* text = da_new(char);
+    srand(19);
+    for (size_t line = 0; line < count; ++line) {
+        int n = rand() % 40;
+        for (int k = 0; k < n; ++k) {
+            const char* piece = pieces[rand() % (sizeof(pieces)/sizeof(*pieces))];
+            for (const char* p = piece; *p; ++p) da_push(text, *p);
+        }
+        da_push(text, '\n');
+    }
+    return text;
+}
+
+int main(int argc, char** argv) {
+    size_t n = bench_size(argc, argv, 100);
+    bench_languages();
+    const Language* lang = &languages[lang_find("bench.c")];
+    printf("lexer on the sources repeated to %zu MB\n", n >> 20);
+
+    FilePathList files = LoadDirectoryFilesEx("src", ".c;.h", false);
+    char* sources = da_new(char);
+    for (unsigned int i = 0; i < files.count; ++i) {
+        int size;
+        unsigned char* data = LoadFileData(files.paths[i], &size);
+        for (int k = 0; k < size; ++k) da_push(sources, (char) data[k]);
+        UnloadFileData(data);
+    }
+    UnloadDirectoryFiles(files);
+    if (da_length(sources) == 0) {
+        printf("  run it from the repository root\n");
+        return 1;
+    }
+    char* text = malloc(n);
+    for (size_t at = 0; at < n; at += da_length(sources)) {
+        memcpy(text + at, sources, n - at < da_length(sources) ? n - at : da_length(sources));
+    }
+    Lines corpus = split(text, n);
+    free(text);
+    char* random = random_lines(BENCH_RANDOM_LINES);
+    Lines mixed = split(random, da_length(random));
+    da_free(random);
+
+    bool avx2[3], ssse3[3];
+    const char* names[3];
+    int count = modes(avx2, ssse3, names);
+    Token* expected = 0;
+    Token* expected_mixed = 0;
+    for (int m = 0; m < count; ++m) {
+        lang_avx2 = avx2[m];
+        lang_ssse3 = ssse3[m];
+        double best = 0;
+        for (int r = 0; r < 3; ++r) {
+            double t = lex(lang, &corpus);
+            if (r == 0 || t < best) best = t;
+        }
+        lex(lang, &mixed);
+        printf("  %-6s %7.1f ms, %4.0f MB/s, %zu tokens\n", names[m], best, (n >> 20)/best*1e3, da_length(corpus.tokens));
+        if (m == 0) {
+            expected = corpus.tokens;
+            expected_mixed = mixed.tokens;
+            corpus.tokens = mixed.tokens = 0;
+            continue;
+        }
+        bench_check(same_tokens(expected, corpus.tokens), TextFormat("%s tokens on the sources", names[m]));
+        bench_check(same_tokens(expected_mixed, mixed.tokens), TextFormat("%s tokens on mixed lines", names[m]));
+    }
+    return bench_failed;
+}
@@ -0,0 +1,81 @@
+// glyph_find against raylib's GetGlyphIndex. Every codepoint of a raylib
+// font has to come back as a glyph for that codepoint with the same
+// advance, control characters and codepoints past Unicode as the '?'
+// fallback, and every glyph has to stay findable as the BMP pages and the
+// astral table grow.
+
+#include "bench.h"
+
+Font reference_font(int* codepoints, int count, int size) {
+    Font font = {0};
+    font.baseSize = size;
+    font.glyphCount = count;
+    font.glyphPadding = 4;
+    font.glyphs = LoadFontData(__FONT_TTF, __FONT_TTF_LENGTH, size, codepoints, count, FONT_DEFAULT);
+    UnloadImage(GenImageFontAtlas(font.glyphs, &font.recs, count, size, 4, 0));
+    return font;
+}
+
+int main(void) {
+    bench_languages();
+    printf("glyph_find against GetGlyphIndex\n");
+    int cyrillic[95 + 256], scattered[95 + 401];
+    int cyrillic_count = 0, scattered_count = 0;
+    for (int c = 32; c < 127; ++c) cyrillic[cyrillic_count++] = scattered[scattered_count++] = c;
+    for (int c = 0x400; c < 0x500; ++c) cyrillic[cyrillic_count++] = c;
+    for (int i = 0; i < 300; ++i) scattered[scattered_count++] = 0x10000 + i*977;
+    for (int i = 0; i < 100; ++i) scattered[scattered_count++] = 0x4E00 + i*31;
+    scattered[scattered_count++] = 0x1F600;
+    int* sets[2] = {cyrillic, scattered};
+    int counts[2] = {cyrillic_count, scattered_count};
+
+    for (int s = 0; s < 2; ++s) {
+        int size = s ? 20 : 24;
+        Font font = reference_font(sets[s], counts[s], size);
+        Glyphs glyphs = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, size);
+        int wrong = 0;
+        for (int k = 0; k < counts[s]; ++k) {
+            int c = sets[s][k];
+            int i = GetGlyphIndex(font, c);
+            float advance = font.glyphs[i].advanceX ? font.glyphs[i].advanceX : font.recs[i].width + font.glyphs[i].offsetX;
+            // Finding it may grow GLYPHS.
+            int found = glyph_find(&glyphs, c);
+            Glyph* glyph = &glyphs.glyphs[found];
+            wrong += glyph->codepoint != c || glyph->advance != advance;
+        }
+        bench_check(wrong == 0, TextFormat("codepoints and advances, set %d", s));
+
+        int fallback = 0;
+        int outside[] = {-1, 0, '\n', '\t', 31, 0x110000, 0x7FFFFFFF};
+        for (size_t k = 0; k < sizeof(outside)/sizeof(*outside); ++k) {
+            fallback += glyph_find(&glyphs, outside[k]) == glyphs.fallback;
+        }
+        bench_check(fallback == sizeof(outside)/sizeof(*outside) && glyphs.glyphs[glyphs.fallback].codepoint == '?',
+                    TextFormat("fallback glyph, set %d", s));
+
+        int lost = 0;
+        for (size_t i = 0; i < da_length(glyphs.glyphs); ++i) {
+            lost += glyph_find(&glyphs, glyphs.glyphs[i].codepoint) != (int) i;
+        }
+        bench_check(lost == 0 && da_length(glyphs.glyphs) == (size_t) counts[s],
+                    TextFormat("%zu glyphs all found again, set %d", da_length(glyphs.glyphs), s));
+
+        if (s == 0) {
+            volatile int sink = 0;
+            double t0 = bench_now();
+            for (int r = 0; r < 10000; ++r) {
+                for (int c = 0x410; c < 0x450; ++c) sink += GetGlyphIndex(font, c);
+            }
+            double t1 = bench_now();
+            for (int r = 0; r < 10000; ++r) {
+                for (int c = 0x410; c < 0x450; ++c) sink += glyph_find(&glyphs, c);
+            }
+            double t2 = bench_now();
+            printf("  a Cyrillic lookup: GetGlyphIndex %.1f ns, glyph_find %.2f ns\n", (t1 - t0)*1e6/640000, (t2 - t1)*1e6/640000);
+        }
+        glyphs_unload(&glyphs);
+        UnloadFontData(font.glyphs, font.glyphCount);
+        free(font.recs);
+    }
+    return bench_failed;
+}
@@ -0,0 +1,106 @@
+// buf_measure and buf_hit against what MeasureTextEx gives for the same
+// text, on random lines mixing ASCII, Cyrillic, CJK and emoji at several
+// sizes, with and without the monospace shortcut.
+
+#include "bench.h"
+
+static const char* alphabet[] = {"a", "Z", " ", "{", "ж", "Я", "中", "é", "😀", "\xD0\x80", "~", "?"};
+#define ALPHABET (sizeof(alphabet)/sizeof(*alphabet))
+
+// A raylib font with the codepoints of the alphabet, for MeasureTextEx.
+Font reference_font(int size) {
+    int codepoints[95 + ALPHABET];
+    int count = 0;
+    for (int c = 32; c < 127; ++c) codepoints[count++] = c;
+    for (size_t i = 0; i < ALPHABET; ++i) {
+        int length;
+        int* c = LoadCodepoints(alphabet[i], &length);
+        if (c[0] >= 127) codepoints[count++] = c[0];
+        UnloadCodepoints(c);
+    }
+    Font font = {0};
+    font.baseSize = size;
+    font.glyphCount = count;
+    font.glyphPadding = 4;
+    font.glyphs = LoadFontData(__FONT_TTF, __FONT_TTF_LENGTH, size, codepoints, count, FONT_DEFAULT);
+    UnloadImage(GenImageFontAtlas(font.glyphs, &font.recs, count, size, 4, 0));
+    // MeasureTextEx gives 0 for fonts without a texture.
+    font.texture.id = 1;
+    return font;
+}
+
+float reference_measure(Buffer* buf, Font font, size_t start, size_t end) {
+    if (end <= start) return 0;
+    char* str = buf_load_utf8(buf, start, end);
+    float width = MeasureTextEx(font, str, font.baseSize, 0).x;
+    free(str);
+    return width;
+}
+
+// The codepoint whose left part X falls in, by measuring every prefix.
+size_t reference_hit(Buffer* buf, Font font, Line line, float x) {
+    if (reference_measure(buf, font, line.start, line.end) < x) return line.end;
+    for (size_t i = line.end; i > line.start; --i) {
+        if (reference_measure(buf, font, line.start, i - 1) < x) return i - 1;
+    }
+    return line.start;
+}
+
+int main(void) {
+    bench_languages();
+    printf("measuring against MeasureTextEx\n");
+    for (int size = 16; size <= 66; size += 10) {
+        Font font = reference_font(size);
+        Glyphs glyphs = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, size);
+        float monospace = glyphs.monospace;
+        for (int pass = 0; pass < 2; ++pass) {
+            // The second pass goes through the advances one at a time.
+            glyphs.monospace = pass ? 0 : monospace;
+            int widths = 0, hits = 0;
+            srand(size);
+            for (int r = 0; r < 200; ++r) {
+                char line_text[40*4 + 1] = "";
+                int n = rand() % 40;
+                for (int k = 0; k < n; ++k) strcat(line_text, alphabet[rand() % ALPHABET]);
+                Buffer buf;
+                bench_buffer(&buf, "bench.txt", strdup(line_text), strlen(line_text));
+                Line line = buf_line(&buf, 0);
+                for (size_t a = line.start; a <= line.end; ++a) {
+                    size_t e = a + rand() % (line.end - a + 1);
+                    widths += buf_measure(&buf, &glyphs, a, e) != reference_measure(&buf, font, a, e);
+                }
+                for (int x = 1; x < 40*size; x += 7) {
+                    hits += buf_hit(&buf, &glyphs, line, x) != reference_hit(&buf, font, line, x);
+                }
+                deinit_buf(&buf);
+            }
+            bench_check(widths == 0 && hits == 0, TextFormat("size %d%s", size, pass ? ", one at a time" : ""));
+        }
+        glyphs_unload(&glyphs);
+        UnloadFontData(font.glyphs, font.glyphCount);
+        free(font.recs);
+    }
+
+    Font font = reference_font(24);
+    Glyphs glyphs = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, 24);
+    const char* text = "    float width = buf_measure(buf, glyphs, line.start, line.end); // жизнь 中文 café";
+    Buffer buf;
+    bench_buffer(&buf, "bench.c", strdup(text), strlen(text));
+    Line line = buf_line(&buf, 0);
+    volatile float sink = 0;
+    double t0 = bench_now();
+    for (int r = 0; r < 10000; ++r) sink += reference_measure(&buf, font, line.start, line.end);
+    double t1 = bench_now();
+    for (int r = 0; r < 10000; ++r) sink += buf_measure(&buf, &glyphs, line.start, line.end);
+    double t2 = bench_now();
+    printf("  a %zu codepoint line: MeasureTextEx %.2f us, buf_measure %.3f us\n",
+           line.end - line.start, (t1 - t0)/10, (t2 - t1)/10);
+    t0 = bench_now();
+    for (int r = 0; r < 100; ++r) sink += reference_hit(&buf, font, line, 500 + r);
+    t1 = bench_now();
+    for (int r = 0; r < 100; ++r) sink += buf_hit(&buf, &glyphs, line, 500 + r);
+    t2 = bench_now();
+    printf("  a click on it: measuring prefixes %.2f us, buf_hit %.3f us\n", (t1 - t0)*10, (t2 - t1)*10);
+    deinit_buf(&buf);
+    return bench_failed;
+}
@@ -0,0 +1,57 @@
+// The codepoint and newline counting kernels over 1 GB, whole and in
+// TEXT_CHUNK pieces the way pieces are counted. All of them have to agree.
+
+#include "bench.h"
+
+typedef struct {
+    const char* name;
+    TextStats (*kernel)(const char*, size_t);
+} Kernel;
+
+int main(int argc, char** argv) {
+    size_t n = bench_size(argc, argv, 1024);
+    char* text = bench_text(n, 7);
+    printf("text_stats kernels, %zu MB\n", n >> 20);
+
+    Kernel kernels[3] = {{"scalar", text_stats_scalar}};
+    int count = 1;
+#ifdef TEXT_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) kernels[count++] = (Kernel) {"sse2", text_stats_sse2};
+    if (__builtin_cpu_supports("avx2")) kernels[count++] = (Kernel) {"avx2", text_stats_avx2};
+#endif
+
+    TextStats expected = kernels[0].kernel(text, n);
+    for (int k = 0; k < count; ++k) {
+        double t0 = bench_now();
+        TextStats whole = kernels[k].kernel(text, n);
+        double t1 = bench_now();
+        TextStats chunked = {0};
+        for (size_t at = 0; at < n; at += TEXT_CHUNK) {
+            text_stats_add(&chunked, kernels[k].kernel(text + at, n - at < TEXT_CHUNK ? n - at : TEXT_CHUNK));
+        }
+        double t2 = bench_now();
+        printf("  %-6s whole %7.1f ms, in chunks %7.1f ms, %zu codepoints, %zu newlines\n",
+               kernels[k].name, t1 - t0, t2 - t1, whole.length, whole.newlines);
+        bool same = whole.length == expected.length && whole.newlines == expected.newlines &&
+                    chunked.length == expected.length && chunked.newlines == expected.newlines;
+        bench_check(same, TextFormat("%s counts", kernels[k].name));
+    }
+
+    // Short runs at every alignment go through the tails.
+    bool same = true;
+    srand(8);
+    for (int r = 0; r < 100000 && same; ++r) {
+        size_t at = rand() % (n - 200);
+        size_t length = rand() % 200;
+        TextStats a = text_stats_scalar(text + at, length);
+        for (int k = 1; k < count; ++k) {
+            TextStats b = kernels[k].kernel(text + at, length);
+            same = same && a.length == b.length && a.newlines == b.newlines;
+        }
+    }
+    bench_check(same, "short unaligned runs");
+
+    free(text);
+    return bench_failed;
+}
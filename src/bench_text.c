@@ -0,0 +1,99 @@
+// The piece table against the flat array it replaced, on 1 GB of text. The
+// array has to move everything after an edit and rebuild its line starts,
+// the piece table only touches a path of its tree.
+
+#include "bench.h"
+
+#define BENCH_EDITS 20
+#define BENCH_PIECE_EDITS 100000
+#define BENCH_LOOKUPS 100000
+
+// Byte offsets of the line starts in the N bytes at TEXT.
+size_t* array_lines(const char* text, size_t n) {
+    size_t* lines = da_new(size_t);
+    da_push(lines, (size_t) 0);
+    for (const char* nl = text; (nl = memchr(nl, '\n', text + n - nl)); nl++) {
+        da_push(lines, (size_t) (nl - text + 1));
+    }
+    return lines;
+}
+
+bool same_text(Text* t, const char* array, size_t n) {
+    if (text_bytes(t) != n) return false;
+    TextIter it;
+    char* span;
+    size_t bytes, at = 0;
+    text_iter_init(t, &it, 0, text_length(t));
+    while (text_iter_next(&it, &span, &bytes, 0)) {
+        if (memcmp(span, array + at, bytes) != 0) return false;
+        at += bytes;
+    }
+    return at == n;
+}
+
+int main(int argc, char** argv) {
+    size_t n = bench_size(argc, argv, 1024);
+    text_select_kernel();
+    const char* insert = "inserted café\n";
+    size_t insert_bytes = strlen(insert);
+    printf("piece table vs array, %zu MB\n", n >> 20);
+
+    char* array = bench_text(n, 2);
+    array = realloc(array, n + BENCH_EDITS*insert_bytes);
+    char* original = malloc(n);
+    memcpy(original, array, n);
+
+    double t0 = bench_now();
+    size_t* lines = array_lines(array, n);
+    double t1 = bench_now();
+    Text t;
+    text_init_from(&t, original, n);
+    double t2 = bench_now();
+    printf("  load:   array %8.1f ms, piece table %8.1f ms\n", t1 - t0, t2 - t1);
+    bench_check(da_length(lines) == text_lines(&t), "line count");
+
+    srand(3);
+    double array_time = 0, piece_time = 0;
+    for (int e = 0; e < BENCH_EDITS; ++e) {
+        size_t at = (size_t) rand()*rand() % (text_length(&t) + 1);
+        size_t byte = text_byte_of(&t, at);
+        t0 = bench_now();
+        memmove(array + byte + insert_bytes, array + byte, n - byte);
+        memcpy(array + byte, insert, insert_bytes);
+        n += insert_bytes;
+        da_free(lines);
+        lines = array_lines(array, n);
+        t1 = bench_now();
+        text_insert_utf8(&t, at, insert, insert_bytes);
+        t2 = bench_now();
+        array_time += t1 - t0;
+        piece_time += t2 - t1;
+    }
+    printf("  insert: array %8.1f ms, piece table %8.4f ms\n", array_time/BENCH_EDITS, piece_time/BENCH_EDITS);
+    bench_check(same_text(&t, array, n), "same text after inserts");
+
+    bool same_lines = da_length(lines) == text_lines(&t);
+    double lookup_time = 0;
+    for (int k = 0; k < BENCH_LOOKUPS && same_lines; ++k) {
+        size_t line = (size_t) rand()*rand() % da_length(lines);
+        t0 = bench_now();
+        size_t start = text_line_start(&t, line);
+        lookup_time += bench_now() - t0;
+        same_lines = text_byte_of(&t, start) == lines[line];
+    }
+    bench_check(same_lines, "same line starts");
+    printf("  line start lookup: piece table %.3f us\n", lookup_time*1e3/BENCH_LOOKUPS);
+
+    t0 = bench_now();
+    for (int e = 0; e < BENCH_PIECE_EDITS; ++e) {
+        text_insert_utf8(&t, (size_t) rand()*rand() % (text_length(&t) + 1), insert, insert_bytes);
+    }
+    t1 = bench_now();
+    printf("  %d more piece table inserts: %.3f us each\n", BENCH_PIECE_EDITS, (t1 - t0)*1e3/BENCH_PIECE_EDITS);
+    bench_check(text_bytes(&t) == n + (size_t) BENCH_PIECE_EDITS*insert_bytes, "byte count after inserts");
+
+    text_free(&t);
+    da_free(lines);
+    free(array);
+    return bench_failed;
+}
@@ -0,0 +1,81 @@
+// Zooming back and forth through load_font. A size zoomed to recently has
+// to come back as the same glyphs without rasterizing again, and every size
+// has to measure like glyphs made for it from scratch.
+
+#include "bench.h"
+
+static const int zooms[] = {26, 28, 30, 28, 26, 24, 26, 28, 30, 32, 30, 28};
+#define ZOOMS (sizeof(zooms)/sizeof(*zooms))
+
+// The way a zoom used to reload the font: the printable ASCII and Cyrillic
+// glyphs baked into one atlas.
+void old_reload(int size) {
+    int codepoints[512] = {0};
+    for (int i = 0; i < 95; i++) codepoints[i] = 32 + i;
+    for (int i = 0; i < 255; i++) codepoints[96 + i] = 0x400 + i;
+    GlyphInfo* info = LoadFontData(__FONT_TTF, __FONT_TTF_LENGTH, size, codepoints, 512, FONT_DEFAULT);
+    Rectangle* recs;
+    Image atlas = GenImageFontAtlas(info, &recs, 512, size, 4, 0);
+    ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA);
+    UnloadTexture(LoadTextureFromImage(atlas));
+    UnloadImage(atlas);
+    UnloadFontData(info, 512);
+    free(recs);
+}
+
+// Whether G advances like fresh glyphs of SIZE on ASCII and Cyrillic.
+bool same_advances(Glyphs* g, int size) {
+    Glyphs fresh = glyphs_init(__FONT_TTF, __FONT_TTF_LENGTH, size);
+    bool same = g->size == size && g->monospace == fresh.monospace;
+    for (int c = 32; c < 0x500 && same; c = c == 126 ? 0x400 : c + 1) {
+        // Finding it may grow GLYPHS.
+        int i = glyph_find(g, c);
+        int k = glyph_find(&fresh, c);
+        same = g->glyphs[i].advance == fresh.glyphs[k].advance;
+    }
+    glyphs_unload(&fresh);
+    return same;
+}
+
+int main(void) {
+    bench_languages();
+    printf("zooming through %zu sizes, %d kept\n", ZOOMS, FONT_SIZES);
+    // The sizes zoomed to, most recent first, and where load_font put them.
+    int recent[ZOOMS];
+    Glyphs* where[ZOOMS];
+    int distinct = 0, wrong_size = 0, reloaded = 0, advances = 0;
+    for (size_t z = 0; z < ZOOMS; ++z) {
+        int size = zooms[z];
+        int seen = 0;
+        while (seen < distinct && recent[seen] != size) seen++;
+        size_t flushes = bench_flushes;
+        Glyphs* g = load_font(size);
+        wrong_size += g->size != size;
+        // Sizes still among the last FONT_SIZES come back untouched.
+        if (seen < FONT_SIZES && seen < distinct) reloaded += g != where[seen] || bench_flushes != flushes;
+        advances += !same_advances(g, size);
+        if (seen == distinct) distinct++;
+        for (int k = seen; k > 0; --k) {
+            recent[k] = recent[k - 1];
+            where[k] = where[k - 1];
+        }
+        recent[0] = size;
+        where[0] = g;
+    }
+    bench_check(wrong_size == 0, "load_font gives the size asked for");
+    bench_check(reloaded == 0, "recent sizes are kept as they were");
+    bench_check(advances == 0, "advances match fresh glyphs of each size");
+
+    volatile int sink = 0;
+    int n = 200;
+    double t0 = bench_now();
+    for (int r = 0; r < n; ++r) sink += load_font(r % 2 ? 26 : 28)->size;
+    double t1 = bench_now();
+    for (int r = 0; r < n; ++r) sink += load_font(40 + 2*(r % 8))->size;
+    double t2 = bench_now();
+    for (int r = 0; r < n; ++r) old_reload(40 + 2*(r % 8));
+    double t3 = bench_now();
+    printf("  a zoom: cached %.2f us, new size %.2f ms, old reload %.2f ms\n",
+           (t1 - t0)*1e3/n, (t2 - t1)/n, (t3 - t2)/n);
+    return bench_failed;
+}
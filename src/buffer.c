@@ -1,122 +1,260 @@
 
 #include <raylib.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 typedef struct {
     size_t start;
     size_t end;
 } Line;
 
+// A run of one token class on a line, from column START for LENGTH
+// codepoints. The class indexes PALETTE.
 typedef struct {
+    uint32_t start;
+    uint16_t length;
+    uint8_t class;
+} Token;
+
+typedef struct {
+    char* data;
+    size_t bytes;
+} LoadChunk;
+
+// A file being read on a worker thread. The worker hands over tab expanded
+// chunks through CHUNKS, the main thread appends them to the buffer.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    FILE* file;
+    LoadChunk* chunks;
+    size_t read;
+    size_t size;
+    bool finished;
+    bool cancel;
+} Loader;
+
+// Lexes a buffer's lines on a worker thread. The main thread posts a pass
+// over a copy of lines [START, END) and, once it's finished, swaps the
+// tokens of lines [FIRST, END) for its own, so there are two token stores
+// that trade places. Only the flags under LOCK are shared while a pass runs.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool running;
+    bool finished;
+    bool cancel;
+    bool quit;
+    // Main thread only: a pass is out and no edit touched its lines, and
+    // how many passes were posted.
+    bool valid;
+    size_t posts;
+    int language;
+    char* text;
+    size_t bytes;
+    // Where line FIRST starts in TEXT.
+    size_t first_byte;
+    size_t start;
+    size_t first;
+    size_t end;
+    size_t known;
+    bool dirty;
+    size_t dirty_end;
+    // Start states of lines [START, END], before and after the pass.
+    unsigned char* states;
+    bool settled;
+    Token* tokens;
+    size_t* offsets;
+} Highlighter;
+
+// Where an offset is, kept between frames. Moving within the line, or
+// asking again without an edit in between, doesn't touch the text tree, and
+// the pixel x is patched by measuring only the part that was moved over.
+typedef struct {
+    bool valid;
+    size_t version;
     size_t line;
     size_t start;
     size_t end;
-    Color color;
-} Token;
+    bool measured;
+    int font_size;
+    size_t x_pos;
+    float x;
+} CursorCache;
 
 typedef struct {
     int* filename;
     size_t filenamel;
-    int* content;
-    Line* lines;
+    Text text;
     size_t cursor;
+    CursorCache cursor_cache;
+    CursorCache selection_cache;
     Token* tokens;
+    int language;
+    // Lexer state at the start of every line, known for the first HL_KNOWN
+    // lines, and the lines an edit made dirty.
+    unsigned char* hl_states;
+    size_t hl_known;
+    size_t hl_dirty_start;
+    size_t hl_dirty_end;
+    // TOKENS covers lines [HL_FIRST, HL_LAST). The tokens of line L start at
+    // HL_OFFSETS[L - HL_FIRST], the last entry is the token count.
+    size_t hl_first;
+    size_t hl_last;
+    size_t* hl_offsets;
+    // Lines edited since the running pass was posted.
+    size_t hl_fresh_start;
+    size_t hl_fresh_end;
+    Highlighter* highlighter;
     bool changed;
     bool readonly;
-    int selection_origin;
+    Loader* loader;
+    // The other end of the selection from the cursor, if HAS_SELECTION.
+    size_t selection_origin;
+    bool has_selection;
     int* search_buffer;
     int is_searching;
 } Buffer;
 
-void buf_get_cursor_pos(Buffer* buf, Font font, int font_size, size_t* lp, size_t* cp) {
-    int y = 0, x = 0;
-    Vector2 lsize;
-    for (size_t l = 0; l < da_length(buf->lines); ++l) {
-        Line line = buf->lines[l];
-        
-        if (line.start <= buf->cursor && buf->cursor <= line.end) {
-            int str[buf->cursor - line.start];
-            memcpy(str, buf->content + line.start, sizeof(int)*(buf->cursor - line.start));
-            char* utf8_string = LoadUTF8(str, buf->cursor - line.start);
-            lsize = MeasureTextEx(font, utf8_string, font_size, 0);
-            UnloadUTF8(utf8_string);
-            x = lsize.x;
-            break;
-        }
+#define LANGUAGE_NONE 0
+#define LANGUAGE_PLAIN 1
+#define LANGUAGE_FILES 2
+#define LANGUAGE_COMMIT 3
+// Languages from definitions, LANGUAGES[language - LANGUAGE_DEFINED].
+#define LANGUAGE_DEFINED 4
 
-        y += font_size;
+// Lexer states carried from one line into the next.
+#define HL_NORMAL 0
+#define HL_COMMENT 1
+
+// Files at least this big are mapped instead of read in.
+#define BUF_MAP_SIZE (64*1024*1024)
+// Bytes of a mapped file indexed per frame.
+#define BUF_INDEX_BUDGET (8*1024*1024)
+// Bytes the loader reads at a time.
+#define BUF_LOAD_CHUNK (256*1024)
+// Lines above the drawn ones are lexed on all cores when they are at least
+// this big, in chunks of at least HL_CHUNK_BYTES.
+#define HL_PARALLEL_BYTES (1024*1024)
+#define HL_CHUNK_BYTES (256*1024)
+
+size_t buf_line_count(Buffer* buf) {
+    return text_lines(&buf->text);
+}
+
+Line buf_line(Buffer* buf, size_t l) {
+    Line line = {text_line_start(&buf->text, l), text_length(&buf->text)};
+    if (l + 1 < buf_line_count(buf)) line.end = text_line_start(&buf->text, l + 1) - 1;
+    return line;
+}
+
+// Copies codepoints [START, END) into a new UTF-8 string, free it with free().
+// Returns null and sets error if there isn't memory for it.
+char* buf_load_utf8(Buffer* buf, size_t start, size_t end) {
+    size_t bytes = end > start ? text_byte_of(&buf->text, end) - text_byte_of(&buf->text, start) : 0;
+    char* str = malloc(bytes + 1);
+    if (str == NULL) {
+        error = strerror(errno);
+        return NULL;
     }
-    *lp = y;
-    *cp = x;
+    text_copy_utf8(&buf->text, start, end, str);
+    return str;
 }
 
-bool buf_get_selection_cursor(Buffer* buf, size_t* lp, size_t* cp) {
-    if (buf->selection_origin < 0) return false;
-    Line res_line = {0};
-    size_t res_l = 0;
-    for (size_t l = 0; l < da_length(buf->lines); ++l) {
-        Line line = buf->lines[l];
-        if ((int) line.start <= buf->selection_origin && buf->selection_origin <= (int) line.end) {
-            res_line = line;
-            res_l = l;
-            break;
+// Width of codepoints [START, END) when drawn with GLYPHS.
+float buf_measure(Buffer* buf, Glyphs* glyphs, size_t start, size_t end) {
+    if (end <= start) return 0;
+    TextIter it;
+    char* span;
+    size_t n, length;
+    float width = 0;
+    text_iter_init(&buf->text, &it, start, end);
+    while (text_iter_next(&it, &span, &n, &length)) {
+        // A span with as many bytes as codepoints is all ASCII.
+        if (glyphs->monospace && n == length) width += length*glyphs->monospace;
+        else width += glyphs_measure_utf8(glyphs, span, n);
+    }
+    return width;
+}
+
+// Where a click X pixels into LINE puts the cursor, which is after the
+// codepoints that end left of X.
+size_t buf_hit(Buffer* buf, Glyphs* glyphs, Line line, float x) {
+    TextIter it;
+    char* span;
+    size_t n, length;
+    float width = 0;
+    size_t pos = line.start;
+    if (x <= 0) return line.start;
+    text_iter_init(&buf->text, &it, line.start, line.end);
+    while (text_iter_next(&it, &span, &n, &length)) {
+        if (glyphs->monospace && n == length && width + length*glyphs->monospace < x) {
+            width += length*glyphs->monospace;
+            pos += length;
+            continue;
+        }
+        for (size_t i = 0; i < n; ++pos) {
+            int size;
+            width += glyph_advance(glyphs, text_utf8_decode(span + i, n - i, &size));
+            if (width >= x) return pos;
+            i += size;
         }
     }
-    *lp = res_l;
-    *cp = buf->selection_origin - res_line.start;
+    return line.end;
+}
+
+void buf_locate(Buffer* buf, CursorCache* cache, size_t pos, size_t* lp, size_t* cp) {
+    if (!cache->valid || cache->version != buf->text.version || pos < cache->start || pos > cache->end) {
+        size_t l = text_line_of(&buf->text, pos);
+        Line line = buf_line(buf, l);
+        *cache = (CursorCache) {true, buf->text.version, l, line.start, line.end, false, 0, 0, 0};
+    }
+    *lp = cache->line;
+    *cp = pos - cache->start;
+}
+
+void buf_get_cursor_pos(Buffer* buf, Glyphs* glyphs, size_t* lp, size_t* cp) {
+    int font_size = glyphs->size;
+    CursorCache* cache = &buf->cursor_cache;
+    size_t l, c;
+    buf_locate(buf, cache, buf->cursor, &l, &c);
+    *lp = l*font_size;
+    if (!cache->measured || cache->font_size != font_size || c == 0) {
+        cache->x = buf_measure(buf, glyphs, cache->start, buf->cursor);
+    } else if (buf->cursor > cache->x_pos) {
+        cache->x += buf_measure(buf, glyphs, cache->x_pos, buf->cursor);
+    } else if (buf->cursor < cache->x_pos) {
+        cache->x -= buf_measure(buf, glyphs, buf->cursor, cache->x_pos);
+    }
+    cache->measured = true;
+    cache->font_size = font_size;
+    cache->x_pos = buf->cursor;
+    *cp = cache->x;
+}
+
+bool buf_get_selection_cursor(Buffer* buf, size_t* lp, size_t* cp) {
+    if (!buf->has_selection) return false;
+    buf_locate(buf, &buf->selection_cache, buf->selection_origin, lp, cp);
+    return true;
+}
+
+void buf_select(Buffer* buf, size_t origin) {
+    buf->selection_origin = origin;
+    buf->has_selection = true;
+}
+
+// Stores the selected codepoints as [START, END), false if nothing is.
+bool buf_get_selection(Buffer* buf, size_t* start, size_t* end) {
+    if (!buf->has_selection) return false;
+    *start = buf->cursor < buf->selection_origin ? buf->cursor : buf->selection_origin;
+    *end = buf->cursor < buf->selection_origin ? buf->selection_origin : buf->cursor;
     return true;
 }
 
 void buf_get_cursor(Buffer* buf, size_t* lp, size_t* cp) {
-    Line res_line = {0};
-    size_t res_l = 0;
-    for (size_t l = 0; l < da_length(buf->lines); ++l) {
-        Line line = buf->lines[l];
-        if (line.start <= buf->cursor && buf->cursor <= line.end) {
-            res_line = line;
-            res_l = l;
-            break;
-        }
-    }
-    *lp = res_l;
-    *cp = buf->cursor - res_line.start;
-}bool needlehaystack(char needle, char* haystack) {
-    while (*haystack != 0) {
-        if (needle == *haystack) return true;
-        haystack++;
-    }
-    return false;
-}
-
-const char *keywords[] = {
-    "auto", "break", "case", "char", "const", "continue", "default", "do", "double",
-    "else", "enum", "extern", "float", "for", "goto", "if", "int", "long", "register",
-    "return", "short", "signed", "sizeof", "static", "struct", "switch", "typedef",
-    "union", "unsigned", "void", "volatile", "while", "alignas", "alignof", "and",
-    "and_eq", "asm", "atomic_cancel", "atomic_commit", "atomic_noexcept", "bitand",
-    "bitor", "bool", "catch", "char16_t", "char32_t", "char8_t", "class", "co_await",
-    "co_return", "co_yield", "compl", "concept", "const_cast", "consteval", "constexpr",
-    "constinit", "decltype", "delete", "dynamic_cast", "explicit", "export", "false",
-    "friend", "inline", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
-    "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "reflexpr",
-    "reinterpret_cast", "requires", "static_assert", "static_cast", "synchronized",
-    "template", "this", "thread_local", "throw", "true", "try", "typeid", "typename",
-    "using", "virtual", "wchar_t", "xor", "xor_eq",
-};
-int keywords_length = 97;
-
-const char *py_keywords[] = {
-    "and",    "as",    "assert", "break",  "class",   "continue", "def",    "del",
-    "elif",   "else",  "except", "False",  "finally", "from",     "global", "if",
-    "import", "in",    "is",     "lambda", "None",    "nonlocal", "not",    "or",
-    "pass",   "raise", "return", "True",   "try",     "while",    "with",   "yield",
-};
-int py_keywords_length = 32;
-
-bool needlehaystack_string(const char* string, const char** list, size_t list_length) {
-    for (size_t i = 0; i < list_length; ++i) {
-        if (strcmp(string, list[i]) == 0) return true;
-    }
-    return false;
+    buf_locate(buf, &buf->cursor_cache, buf->cursor, lp, cp);
 }
 
 bool endswith(const char* str, char* end) {
@@ -127,217 +265,612 @@ bool endswith(const char* str, char* end) {
     return strcmp(str, end) == 0;
 }
 
-void color_highlight_simple(Buffer* buf) {
-    for (size_t i = 0; i < da_length(buf->lines); i++) {
-        int line_length = buf->lines[i].end - buf->lines[i].start;
-        Token token = {i, 0, line_length, DEFAULT};
-        da_push(buf->tokens, token);
-    }
-}
-
-void color_highlight_basic(Buffer* buf, const char** keywords, int keywords_length, int comment_type) {
-    bool comment = false;
-    for (size_t i = 0; i < da_length(buf->lines); i++) {
-        bool preprocessor_line = false;
-        bool done_preprocessor = false;
-        Line line = buf->lines[i];
-        int line_length = line.end-line.start;
-
-        for (int j = 0; j < line_length;) {
-            char ch = buf->content[line.start + j];
-            if (isalpha(ch) && !comment) {
-                size_t length = 1;
-                j++; while ((isalnum(buf->content[line.start + j]) || buf->content[line.start + j] == '_') && j < line_length) { length++; j++; }
-
-                int* b = malloc(sizeof(int)*length);
-                memcpy(b, buf->content + line.start + j - length, sizeof(int)*length);
-                char* bu = LoadUTF8(b, length);
-
-                bool keyword = needlehaystack_string(bu, keywords, keywords_length);
-                free(b);
-                UnloadUTF8(bu);
-
-                Token token = {i, j-length, j, preprocessor_line ? (!done_preprocessor ? PREPROCESSOR : (keyword ? KWORD : DEFAULT)) : (keyword ? KWORD : DEFAULT)};
-                done_preprocessor = true;
-                da_push(buf->tokens, token);
-            } else if (isdigit(ch) && !comment) {
-                size_t length = 1;
-                j++; while ((isdigit(buf->content[line.start + j]) || needlehaystack(buf->content[line.start + j], "xlL.abcdefABCDEF")) && j < line_length) { length++; j++; }
-                Token token = {i, j-length, j, NUMBER};
-                da_push(buf->tokens, token);
-            } else if ((ch == '"' || ch == '\'') && !comment) {
-                size_t length = 0;
-                if (j < line_length) { j++; length++; }
-                while (buf->content[line.start + j] != ch && j < line_length) { length++; j++; }
-                if (j < line_length) { j++; length++; }
-                Token token = {i, j-length, j, STRING};
-                da_push(buf->tokens, token);
-            } else if (ch == '<' && preprocessor_line && !comment) {
-                size_t length = 0;
-                if (j < line_length) { j++; length++; }
-                while (buf->content[line.start + j] != '>' && j < line_length) { length++; j++; }
-                if (j < line_length) { j++; length++; }
-                Token token = {i, j-length, j, STRING};
-                da_push(buf->tokens, token);
-            } else {
-                if (comment && comment_type == 0) {
-                    bool comment_end = false;
-                    for (int c = 0; c < line_length; c++) {
-                        if (buf->content[line.start + j + c] == '*' && j < line_length-1 && buf->content[line.start + j + c + 1] == '/') {
-                            Token token = {i, 0, j+c+2, COMMENT};
-                            da_push(buf->tokens, token);
-                            j += c + 2;
-                            comment = false;
-                            comment_end = true;
-                            break;
-                        }
-                    }
-                    if (!comment_end) {
-                        Token token = {i, 0, line_length, COMMENT};
-                        da_push(buf->tokens, token);
-                        j = line_length;
-                    }
-                    continue;
-                }
-                Color color = {0};
-                if (ch == '#' && comment_type == 0) {
-                    color = PREPROCESSOR;
-                    preprocessor_line = true;
-                } else if (ch == '/' && j < line_length-1 && buf->content[line.start + j + 1] == '/' && comment_type == 0) {
-                    Token token = {i, j, line_length, COMMENT};
-                    da_push(buf->tokens, token);
-                    j = line_length;
-                } else if (ch == '/' && j < line_length-1 && buf->content[line.start + j + 1] == '*' && comment_type == 0) {
-                    comment = true;
-                    for (int c = j; c < line_length; c++) {
-                        if (buf->content[line.start + c] == '*' && j < line_length-1 && buf->content[line.start + c + 1] == '/') {
-                            comment = false;
-                            Token token = {i, j, c + 2, COMMENT};
-                            da_push(buf->tokens, token);
-                            j = c+2;
-                            break;
-                        }
-                    }
-                    if (comment) {
-                        Token token = {i, j, line_length, COMMENT};
-                        da_push(buf->tokens, token);
-                        j = line_length;
-                    }
-                    continue;
-                } else if (comment_type == 1 && ch == '#') {
-                    Token token = {i, j, line_length, COMMENT};
-                    da_push(buf->tokens, token);
-                    j = line_length;
-                }
-                else color = DEFAULT;
-                Token token = {i, j, j+1, color};
-                da_push(buf->tokens, token);
-                j++;
-            }
+// Tokens of LINE, null if it isn't covered.
+Token* buf_line_tokens(Buffer* buf, size_t line, size_t* count) {
+    if (buf->hl_offsets == 0 || line < buf->hl_first || line >= buf->hl_last) return 0;
+    size_t* offsets = buf->hl_offsets + (line - buf->hl_first);
+    *count = offsets[1] - offsets[0];
+    return buf->tokens + offsets[0];
+}
+
+// Drops the tokens and offsets of covered lines [A, B). The caller moves
+// HL_FIRST and HL_LAST.
+void hl_remove_lines(Buffer* buf, size_t a, size_t b) {
+    if (a >= b) return;
+    size_t* offsets = buf->hl_offsets;
+    size_t ta = offsets[a - buf->hl_first], tb = offsets[b - buf->hl_first];
+    buf->tokens = da_splice(buf->tokens, ta, tb - ta, 0, 0);
+    buf->hl_offsets = offsets = da_splice(offsets, a - buf->hl_first, b - a, 0, 0);
+    for (size_t k = a - buf->hl_first; k < da_length(offsets); ++k) offsets[k] -= tb - ta;
+}
+
+// Appends the token [START, END) of the line being lexed. It is merged into
+// the previous token when that one has the same class and ends where this
+// one starts. Lexers cover every column of a line from 0 on, so a token
+// starting at column 0 never merges with the line before.
+void hl_push(Token** tokens, size_t start, size_t end, unsigned char class) {
+    while (start < end) {
+        size_t n = da_length(*tokens);
+        Token* prev = n ? &(*tokens)[n - 1] : 0;
+        if (prev && start > 0 && prev->class == class && prev->start + prev->length == start && prev->length < UINT16_MAX) {
+            size_t add = end - start < (size_t) UINT16_MAX - prev->length ? end - start : (size_t) UINT16_MAX - prev->length;
+            prev->length += add;
+            start += add;
+            continue;
         }
+        size_t length = end - start < UINT16_MAX ? end - start : UINT16_MAX;
+        Token token = {start, length, class};
+        da_push(*tokens, token);
+        start += length;
     }
 }
 
-void color_highlight_c(Buffer* buf) {
-    color_highlight_basic(buf, keywords, keywords_length, 0);
+// Whether DELIMITER, if it isn't empty, is at J.
+bool lang_match(const int* content, int length, int j, const char* delimiter) {
+    if (delimiter[0] == '\0') return false;
+    for (int k = 0; delimiter[k]; ++k) {
+        if (j + k >= length || content[j + k] != delimiter[k]) return false;
+    }
+    return true;
 }
 
-void color_highlight_py(Buffer* buf) {
-    color_highlight_basic(buf, py_keywords, py_keywords_length, 1);
+// Index just past the end of the block comment that is open at J, -1 if it
+// doesn't end on the line.
+int lang_block_end(const Language* lang, const int* content, int length, int j) {
+    size_t n = strlen(lang->block_end);
+    while ((j = lang_run(lang, LX_COMMENT, content, j, length)) < length) {
+        if (lang_match(content, length, j, lang->block_end)) return j + n;
+        j++;
+    }
+    return -1;
 }
 
-void color_highlight_openfile(Buffer* buf) {
-    for (size_t i = 0; i < da_length(buf->lines); i++) {
-        Color color = {0};
-
-        if (i == 0) {
-            color = KWORD;
-        } else if (i == 1) {
-            color = COMMENT;
-        } else if (buf->content[buf->lines[i].end-1] == '/' || i == 2) {
-            color = NUMBER;
+// Lexes a line with the tables of LANG. Characters are looked up in its
+// class table, and the class picks the action in the row of the current
+// state. Only characters whose class may start a delimiter are compared
+// against the delimiters, and the insides of tokens are skipped with
+// lang_run.
+unsigned char lang_highlight_line(const Language* lang, int* content, int length, unsigned char state, Token** tokens) {
+    int j = 0;
+    if (state == HL_COMMENT) {
+        j = lang_block_end(lang, content, length, 0);
+        hl_push(tokens, 0, j < 0 ? length : j, TOKEN_COMMENT);
+        if (j < 0) return HL_COMMENT;
+    }
+    bool preprocessor_line = false;
+    bool seen_ident = false;
+    while (j < length) {
+        int start = j;
+        int c = content[j];
+        int cls = LANGUAGE_CLASS(lang, c);
+        if (lang->delimiter[cls]) {
+            if (lang_match(content, length, j, lang->block_start)) {
+                int end = lang_block_end(lang, content, length, j + strlen(lang->block_start));
+                hl_push(tokens, j, end < 0 ? length : end, TOKEN_COMMENT);
+                if (end < 0) return HL_COMMENT;
+                j = end;
+                continue;
+            }
+            if (lang_match(content, length, j, lang->line_comment)) {
+                hl_push(tokens, j, length, TOKEN_COMMENT);
+                return HL_NORMAL;
+            }
+            char* quote = strchr(lang->strings, c);
+            if (quote) {
+                int row = LX_STRING + (quote - lang->strings);
+                j++;
+                while ((j = lang_run(lang, row, content, j, length)) < length) {
+                    unsigned char action = lang->table[row][LANGUAGE_CLASS(lang, content[j])];
+                    j += action == LX_ESCAPE ? 2 : 1;
+                    if (action == LX_CLOSE) break;
+                }
+                if (j > length) j = length;
+                hl_push(tokens, start, j, TOKEN_STRING);
+                continue;
+            }
+            if (preprocessor_line && c == lang->preprocessor_string[0]) {
+                j++;
+                while (j < length && content[j] != lang->preprocessor_string[1]) j++;
+                if (j < length) j++;
+                hl_push(tokens, start, j, TOKEN_STRING);
+                continue;
+            }
+            if (c == lang->preprocessor) {
+                preprocessor_line = true;
+                hl_push(tokens, j, j + 1, TOKEN_PREPROCESSOR);
+                j++;
+                continue;
+            }
+        }
+        unsigned char action = lang->table[LX_CODE][cls];
+        if (action == LX_START_IDENT) {
+            j = lang_run(lang, LX_IDENT, content, j + 1, length);
+            unsigned char class = keyword_find(&lang->keywords, content + start, j - start) ? TOKEN_KWORD : TOKEN_DEFAULT;
+            if (preprocessor_line && !seen_ident) class = TOKEN_PREPROCESSOR;
+            seen_ident = true;
+            hl_push(tokens, start, j, class);
+        } else if (action == LX_START_NUMBER) {
+            j = lang_run(lang, LX_NUMBER, content, j + 1, length);
+            hl_push(tokens, start, j, TOKEN_NUMBER);
         } else {
-            color = DEFAULT;
+            j = lang_run(lang, LX_CODE, content, j + 1, length);
+            hl_push(tokens, start, j, TOKEN_DEFAULT);
         }
-
-        int line_length = buf->lines[i].end - buf->lines[i].start;
-        Token token = {i, 0, line_length, color};
-        da_push(buf->tokens, token);
     }
+    return HL_NORMAL;
 }
 
-void color_highlight_commiteditmsg(Buffer* buf) {
-    for (size_t i = 0; i < da_length(buf->lines); i++) {
-        Line line = buf->lines[i];
-        size_t line_length = line.end-line.start;
+unsigned char color_highlight_line(int language, size_t i, int* content, int line_length, unsigned char state, Token** tokens) {
+    if (language >= LANGUAGE_DEFINED) {
+        return lang_highlight_line(&languages[language - LANGUAGE_DEFINED], content, line_length, state, tokens);
+    } else if (language == LANGUAGE_FILES) {
+        unsigned char class = TOKEN_DEFAULT;
+        if (i == 0) class = TOKEN_KWORD;
+        else if (i == 1) class = TOKEN_COMMENT;
+        else if ((line_length > 0 && content[line_length-1] == '/') || i == 2) class = TOKEN_NUMBER;
+        hl_push(tokens, 0, line_length, class);
+    } else if (language == LANGUAGE_COMMIT) {
         int comment = -1;
-
-        for (size_t j = 0; j < line_length; ++j) {
-            if (buf->content[line.start+j] == '#') {
+        for (int j = 0; j < line_length; ++j) {
+            if (content[j] == '#') {
                 comment = j;
                 break;
             }
         }
 
-        Color color = {0};
+        unsigned char class = TOKEN_DEFAULT;
         if (i == 0) {
-            color = KWORD;
+            class = TOKEN_KWORD;
         } else if (i == 1) {
-            color = ERROR;
+            class = TOKEN_ERROR;
         } else {
-            color = DEFAULT;
+            class = TOKEN_DEFAULT;
         }
-        
+
         if (comment >= 0) {
-            Token token = {i, 0, comment, color};
-            da_push(buf->tokens, token);
-            Token token2 = {i, comment, line_length, COMMENT};
-            da_push(buf->tokens, token2);
+            hl_push(tokens, 0, comment, class);
+            hl_push(tokens, comment, line_length, TOKEN_COMMENT);
         } else {
-            Token token = {i, 0, line_length, color};
-            da_push(buf->tokens, token);
+            hl_push(tokens, 0, line_length, class);
+        }
+    } else {
+        hl_push(tokens, 0, line_length, TOKEN_DEFAULT);
+    }
+    return state;
+}
+
+// Whether the pass was cancelled or the worker told to quit.
+bool hl_cancelled(Highlighter* h) {
+    pthread_mutex_lock(&h->lock);
+    bool cancel = h->cancel || h->quit;
+    pthread_mutex_unlock(&h->lock);
+    return cancel;
+}
+
+// Lines [LINE, LINE+LINES) of a pass, TEXT to TEXT_END, lexed on a thread of
+// their own before the state they start in is known.
+typedef struct {
+    pthread_t thread;
+    Highlighter* h;
+    char* text;
+    char* text_end;
+    size_t line;
+    size_t lines;
+    // Start states of the lines after each one when starting in HL_COMMENT,
+    // up to where they match the ones from starting in HL_NORMAL.
+    unsigned char* comment_states;
+    size_t comment_lines;
+} HlChunk;
+
+// Lexes the lines of CHUNK from STATE and stores the states that follow
+// in STATES. Stops early once those match SAME. Returns how many it stored.
+size_t hl_chunk_lex(HlChunk* chunk, unsigned char state, unsigned char* states, unsigned char* same) {
+    Highlighter* h = chunk->h;
+    Token* scratch = da_new(Token);
+    int* content = 0;
+    size_t content_size = 0;
+    char* p = chunk->text;
+    size_t k = 0;
+    for (; k < chunk->lines; ++k) {
+        if (k % 4096 == 0 && hl_cancelled(h)) break;
+        char* nl = memchr(p, '\n', chunk->text_end - p);
+        size_t bytes = (nl ? nl : chunk->text_end) - p;
+        if (bytes + 1 > content_size) {
+            content_size = bytes + 1;
+            content = realloc(content, content_size*sizeof(int));
+        }
+        int length = 0;
+        for (size_t b = 0; b < bytes;) {
+            int size;
+            content[length++] = text_utf8_decode(p + b, bytes - b, &size);
+            b += size;
+        }
+        content[length] = 0;
+        _da_set(scratch, DA_LENGTH, 0);
+        state = color_highlight_line(h->language, chunk->line + k, content, length, state, &scratch);
+        p = nl ? nl + 1 : chunk->text_end;
+        states[k] = state;
+        if (same && same[k] == state) {
+            k++;
+            break;
+        }
+    }
+    free(content);
+    da_free(scratch);
+    return k;
+}
+
+void* hl_chunk_worker(void* arg) {
+    HlChunk* chunk = arg;
+    unsigned char* states = chunk->h->states + (chunk->line + 1 - chunk->h->start);
+    hl_chunk_lex(chunk, HL_NORMAL, states, 0);
+    chunk->comment_states = malloc(chunk->lines);
+    chunk->comment_lines = hl_chunk_lex(chunk, HL_COMMENT, chunk->comment_states, states);
+    return 0;
+}
+
+int hl_cpus() {
+#ifdef _WIN32
+    return pthread_num_processors_np();
+#else
+    return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+// Works out the start states of lines [LINE, LINE+LINES), TEXT to TEXT_END,
+// with every core. The text is cut into chunks at line ends, each one lexed
+// from both states at once, and the chunks are then chained in order, each
+// taking the run for the state the one before really ended in.
+void hl_states_parallel(Highlighter* h, size_t line, char* text, char* text_end, unsigned char state) {
+    size_t bytes = text_end - text;
+    size_t count = hl_cpus();
+    if (count > bytes / HL_CHUNK_BYTES) count = bytes / HL_CHUNK_BYTES;
+    if (count < 1) count = 1;
+    HlChunk* chunks = calloc(count, sizeof(HlChunk));
+    char* p = text;
+    for (size_t c = 0; c < count; ++c) {
+        char* end = c + 1 == count ? text_end : text + bytes / count * (c + 1);
+        if (end < p) end = p;
+        if (end < text_end) {
+            char* nl = memchr(end, '\n', text_end - end);
+            end = nl ? nl + 1 : text_end;
+        }
+        size_t lines = text_count_newlines(p, end - p);
+        chunks[c] = (HlChunk) {.h = h, .text = p, .text_end = end, .line = line, .lines = lines};
+        line += lines;
+        p = end;
+    }
+    for (size_t c = 0; c < count; ++c) pthread_create(&chunks[c].thread, 0, hl_chunk_worker, &chunks[c]);
+    for (size_t c = 0; c < count; ++c) pthread_join(chunks[c].thread, 0);
+    for (size_t c = 0; c < count; ++c) {
+        HlChunk* chunk = &chunks[c];
+        unsigned char* states = h->states + (chunk->line + 1 - h->start);
+        if (state == HL_COMMENT) memcpy(states, chunk->comment_states, chunk->comment_lines);
+        if (chunk->lines > 0) state = states[chunk->lines - 1];
+        free(chunk->comment_states);
+    }
+    free(chunks);
+}
+
+// Runs the posted pass. Start states are redone from START on. Past a dirty
+// pass's DIRTY_END, once a line ends in the state the next one already had,
+// the rest of them are known and lexing jumps ahead to FIRST.
+void hl_pass(Highlighter* h) {
+    Token* scratch = da_new(Token);
+    int* content = 0;
+    size_t content_size = 0;
+    _da_set(h->tokens, DA_LENGTH, 0);
+    _da_set(h->offsets, DA_LENGTH, 0);
+    char* p = h->text;
+    char* text_end = h->text + h->bytes;
+    unsigned char state = h->states[0];
+    size_t skip_to = h->first < h->known - 1 ? h->first : h->known - 1;
+    bool settled = false;
+    for (size_t i = h->start; i < h->end;) {
+        if (hl_cancelled(h)) break;
+        bool checking = h->dirty && !settled && i < h->known;
+        if (i < h->first && !checking && h->first_byte - (p - h->text) >= HL_PARALLEL_BYTES) {
+            hl_states_parallel(h, i, p, h->text + h->first_byte, state);
+            p = h->text + h->first_byte;
+            i = h->first;
+            state = h->states[i - h->start];
+            continue;
+        }
+        char* nl = memchr(p, '\n', text_end - p);
+        size_t bytes = (nl ? nl : text_end) - p;
+        if (bytes + 1 > content_size) {
+            content_size = bytes + 1;
+            content = realloc(content, content_size*sizeof(int));
+        }
+        int length = 0;
+        for (size_t k = 0; k < bytes;) {
+            int size;
+            content[length++] = text_utf8_decode(p + k, bytes - k, &size);
+            k += size;
+        }
+        content[length] = 0;
+
+        Token** tokens = &scratch;
+        if (i >= h->first) {
+            da_push(h->offsets, da_length(h->tokens));
+            tokens = &h->tokens;
+        } else _da_set(scratch, DA_LENGTH, 0);
+        state = color_highlight_line(h->language, i, content, length, state, tokens);
+        p = nl ? nl + 1 : text_end;
+        i++;
+        if (h->dirty && !settled && i >= h->dirty_end && i < h->known && h->states[i - h->start] == state) settled = true;
+        h->states[i - h->start] = state;
+        if (settled && i < skip_to) {
+            for (; i < skip_to; ++i) p = (char*) memchr(p, '\n', text_end - p) + 1;
+            state = h->states[i - h->start];
         }
     }
+    da_push(h->offsets, da_length(h->tokens));
+    h->settled = settled;
+    free(content);
+    da_free(scratch);
+}
+
+void* hl_worker(void* arg) {
+    Highlighter* h = arg;
+    pthread_mutex_lock(&h->lock);
+    while (true) {
+        while (!h->quit && !h->running) pthread_cond_wait(&h->wake, &h->lock);
+        if (h->quit) break;
+        pthread_mutex_unlock(&h->lock);
+        hl_pass(h);
+        pthread_mutex_lock(&h->lock);
+        h->running = false;
+        h->finished = true;
+    }
+    pthread_mutex_unlock(&h->lock);
+    return 0;
+}
+
+// Appends codepoints [START, END) of T to the pass's text.
+void hl_copy(Highlighter* h, size_t* capacity, Text* t, size_t start, size_t end) {
+    TextIter it;
+    char* span;
+    size_t bytes;
+    text_iter_init(t, &it, start, end);
+    while (text_iter_next(&it, &span, &bytes, 0)) {
+        if (h->bytes + bytes > *capacity) {
+            while (h->bytes + bytes > *capacity) *capacity *= 2;
+            h->text = realloc(h->text, *capacity);
+        }
+        memcpy(h->text + h->bytes, span, bytes);
+        h->bytes += bytes;
+    }
+}
+
+// Hands lines [START, FIRST) for states and [FIRST, LAST) for tokens to the
+// worker, along with a copy of their text, and starts it on them.
+void hl_post(Buffer* buf, size_t start, size_t first, size_t last) {
+    Highlighter* h = buf->highlighter;
+    if (h == 0) {
+        h = buf->highlighter = calloc(1, sizeof(Highlighter));
+        h->states = da_new(unsigned char);
+        h->tokens = da_new(Token);
+        h->offsets = da_new(size_t);
+        pthread_mutex_init(&h->lock, 0);
+        pthread_cond_init(&h->wake, 0);
+        pthread_create(&h->thread, 0, hl_worker, h);
+    }
+    size_t lines = buf_line_count(buf);
+    h->language = buf->language;
+    h->start = start;
+    h->first = first;
+    h->end = last;
+    h->known = buf->hl_known;
+    h->dirty = buf->hl_dirty_start < buf->hl_dirty_end;
+    h->dirty_end = buf->hl_dirty_end;
+    size_t n = (last < lines ? last + 1 : lines) - start;
+    _da_set(h->states, DA_LENGTH, 0);
+    h->states = da_splice(h->states, 0, 0, buf->hl_states + start, n);
+    h->states = da_splice(h->states, n, 0, 0, last - start + 1 - n);
+
+    size_t capacity = 4096;
+    h->text = malloc(capacity);
+    h->bytes = 0;
+    size_t at = text_line_start(&buf->text, first);
+    hl_copy(h, &capacity, &buf->text, text_line_start(&buf->text, start), at);
+    h->first_byte = h->bytes;
+    hl_copy(h, &capacity, &buf->text, at, last < lines ? text_line_start(&buf->text, last) : text_length(&buf->text));
+
+    h->valid = true;
+    h->posts++;
+    buf->hl_fresh_start = buf->hl_fresh_end = 0;
+    pthread_mutex_lock(&h->lock);
+    h->cancel = false;
+    h->running = true;
+    pthread_cond_signal(&h->wake);
+    pthread_mutex_unlock(&h->lock);
+}
+
+// Swaps the tokens of a finished pass in and takes its states.
+void hl_install(Buffer* buf) {
+    Highlighter* h = buf->highlighter;
+    size_t lines = buf_line_count(buf);
+    for (size_t i = h->start; i <= h->end && i < lines; ++i) buf->hl_states[i] = h->states[i - h->start];
+    // A dirty pass that didn't settle leaves the states past it unknown.
+    size_t known = h->end + 1 < lines ? h->end + 1 : lines;
+    if ((!h->dirty || h->settled) && buf->hl_known > known) known = buf->hl_known;
+    buf->hl_known = known;
+    buf->hl_dirty_start = buf->hl_fresh_start;
+    buf->hl_dirty_end = buf->hl_fresh_end;
+
+    Token* tokens = buf->tokens;
+    buf->tokens = h->tokens;
+    h->tokens = tokens;
+    size_t* offsets = buf->hl_offsets;
+    buf->hl_offsets = h->offsets;
+    h->offsets = offsets;
+    buf->hl_first = h->first;
+    buf->hl_last = h->end;
+}
+
+// Takes a finished pass in. Returns true while one is still running.
+bool hl_poll(Buffer* buf) {
+    Highlighter* h = buf->highlighter;
+    if (h == 0) return false;
+    pthread_mutex_lock(&h->lock);
+    bool running = h->running, finished = h->finished;
+    h->finished = false;
+    pthread_mutex_unlock(&h->lock);
+    if (finished) {
+        if (h->valid) hl_install(buf);
+        h->valid = false;
+        free(h->text);
+        h->text = 0;
+    }
+    return running;
+}
+
+// Throws away the pass in flight, the lines it works on changed.
+void hl_cancel(Buffer* buf) {
+    Highlighter* h = buf->highlighter;
+    if (h == 0 || !h->valid) return;
+    h->valid = false;
+    pthread_mutex_lock(&h->lock);
+    h->cancel = true;
+    pthread_mutex_unlock(&h->lock);
+}
+
+void hl_stop(Buffer* buf) {
+    Highlighter* h = buf->highlighter;
+    if (h == 0) return;
+    pthread_mutex_lock(&h->lock);
+    h->quit = true;
+    pthread_cond_signal(&h->wake);
+    pthread_mutex_unlock(&h->lock);
+    pthread_join(h->thread, 0);
+    free(h->text);
+    da_free(h->states);
+    da_free(h->tokens);
+    da_free(h->offsets);
+    pthread_cond_destroy(&h->wake);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+    buf->highlighter = 0;
+}
+
+// Keeps TOKENS covering lines [FIRST, LAST), the ones about to be drawn.
+// Lexing happens on the worker: when those lines aren't covered or an edit
+// made lines dirty, a pass over them plus HL_MARGIN lines either way is
+// posted, starting from the first dirty line or the last known state. Until
+// it is done the old tokens, shifted along with the edits, are drawn. Frames
+// without edits or scrolling past the margin do no lexing at all. Returns
+// true while a pass is running.
+bool color_highlight_update(Buffer* buf, size_t first, size_t last) {
+    if (buf->language == LANGUAGE_NONE) return false;
+    if (hl_poll(buf)) return true;
+    size_t lines = buf_line_count(buf);
+    if (last > lines) last = lines;
+    if (first > last) first = last;
+    if (buf->hl_dirty_start >= buf->hl_known) buf->hl_dirty_start = buf->hl_dirty_end = 0;
+    bool dirty = buf->hl_dirty_start < buf->hl_dirty_end;
+    bool covered = first == last || (buf->hl_first <= first && last <= buf->hl_last);
+    if (!dirty && covered) return false;
+
+    first = first > (size_t) HL_MARGIN ? first - HL_MARGIN : 0;
+    last += HL_MARGIN;
+    if (last > lines) last = lines;
+    size_t start = first;
+    if (dirty && buf->hl_dirty_start < start) start = buf->hl_dirty_start;
+    if (buf->hl_known - 1 < start) start = buf->hl_known - 1;
+    hl_post(buf, start, first, last);
+    return true;
+}
+
+// Where line bound P ends up once lines [LINE, LINE+REMOVED] became
+// [LINE, LINE+ADDED].
+size_t hl_shift(size_t p, size_t line, size_t removed, size_t added) {
+    if (p > line + removed) return p - removed + added;
+    if (p > line) return line + 1;
+    return p;
+}
+
+// Adds lines [LINE, LINE+ADDED] to the range [*START, *END) after lines
+// [LINE, LINE+REMOVED] became them.
+void hl_mark(size_t* start, size_t* end, size_t line, size_t removed, size_t added) {
+    size_t e = line + added + 1;
+    if (*start < *end) {
+        size_t old_end = hl_shift(*end, line, removed, added);
+        if (old_end > e) e = old_end;
+        if (*start < line) line = *start;
+    }
+    *start = line;
+    *end = e;
+}
+
+// Lines [LINE, LINE+REMOVED] became [LINE, LINE+ADDED]. Drops the lexer data
+// of the lines that went away, shifts the rest and marks the new ones dirty.
+void buf_lines_changed(Buffer* buf, size_t line, size_t removed, size_t added) {
+    if (buf->language == LANGUAGE_NONE) return;
+    if (buf->highlighter && line < buf->highlighter->end) hl_cancel(buf);
+    size_t first = buf->hl_first, last = buf->hl_last;
+    size_t a = line + 1 > first ? line + 1 : first;
+    size_t b = line + removed + 1 < last ? line + removed + 1 : last;
+    if (a < b) {
+        hl_remove_lines(buf, a, b);
+        last -= b - a;
+    }
+    last = hl_shift(first, line, removed, 0) + (last - first);
+    first = hl_shift(first, line, removed, 0);
+    if (line + 1 <= first) {
+        first += added;
+        last += added;
+    } else if (line + 1 <= last) {
+        size_t k = line + 1 - first;
+        size_t* offsets = buf->hl_offsets = da_splice(buf->hl_offsets, k, 0, 0, added);
+        for (size_t j = k; j < k + added; ++j) offsets[j] = offsets[k + added];
+        last += added;
+    }
+    buf->hl_first = first;
+    buf->hl_last = last;
+
+    buf->hl_states = da_splice(buf->hl_states, line + 1, removed, 0, added);
+    buf->hl_known = hl_shift(buf->hl_known, line, removed, added);
+
+    hl_mark(&buf->hl_dirty_start, &buf->hl_dirty_end, line, removed, added);
+    hl_mark(&buf->hl_fresh_start, &buf->hl_fresh_end, line, removed, added);
 }
 
+// Throws away all tokens and lexer states, the next update starts over.
 void color_highlight(Buffer* buf) {
+    hl_cancel(buf);
     da_free(buf->tokens);
     buf->tokens = da_new(Token);
-    if (buf->filename == 0) { color_highlight_simple(buf); return; }
-    char* utf8_string = LoadUTF8(buf->filename, buf->filenamel);
-    if (endswith(utf8_string, ".c") || endswith(utf8_string, ".h"))
-        color_highlight_c(buf);
-    else if (endswith(utf8_string, ".py") || endswith(utf8_string, ".py"))
-        color_highlight_py(buf);
-    else if (strcmp(utf8_string, "Open a file...") == 0 || strcmp(utf8_string, "Save a file...") == 0)
-        color_highlight_openfile(buf);
-    else if (endswith(utf8_string, "COMMIT_EDITMSG"))
-        color_highlight_commiteditmsg(buf);
-    else color_highlight_simple(buf);
-    UnloadUTF8(utf8_string);
-}
-
-void update_newlines(Buffer* buf) {
-    da_free(buf->lines);
-    buf->lines = da_new(Line);
-    int start = 0;
-    for (size_t i = 0; i < da_length(buf->content); ++i) {
-        if (buf->content[i] == '\n') {
-            Line line = {start, i};
-            da_push(buf->lines, line);
-            start = i + 1;
-        }
+    if (buf->hl_states) da_free(buf->hl_states);
+    buf->hl_states = da_new(unsigned char);
+    buf->hl_dirty_start = buf->hl_dirty_end = 0;
+    buf->hl_fresh_start = buf->hl_fresh_end = 0;
+    buf->hl_known = 1;
+    buf->hl_first = buf->hl_last = 0;
+    if (buf->hl_offsets) da_free(buf->hl_offsets);
+    buf->hl_offsets = da_new(size_t);
+    da_push(buf->hl_offsets, (size_t) 0);
+    buf->language = LANGUAGE_PLAIN;
+    if (buf->filename != 0) {
+        char* utf8_string = LoadUTF8(buf->filename, buf->filenamel);
+        int defined = lang_find(utf8_string);
+        if (defined >= 0)
+            buf->language = LANGUAGE_DEFINED + defined;
+        else if (strcmp(utf8_string, "Open a file...") == 0 || strcmp(utf8_string, "Save a file...") == 0)
+            buf->language = LANGUAGE_FILES;
+        else if (endswith(utf8_string, "COMMIT_EDITMSG"))
+            buf->language = LANGUAGE_COMMIT;
+        UnloadUTF8(utf8_string);
     }
-    Line line = {start, da_length(buf->content)};
-    da_push(buf->lines, line);
+
+    size_t lines = buf_line_count(buf);
+    buf->hl_states = da_splice(buf->hl_states, 0, 0, 0, lines);
 }
 
 void init_help_buffer(Buffer* buf) {
-    buf->lines = da_new(Line);
-    buf->content = da_new(int);
     buf->tokens = da_new(Token);
     buf->search_buffer = da_new(int);
-    buf->selection_origin = -1;
+    buf->has_selection = false;
     int ustrl = 0;
     int* ustr = LoadCodepoints("Help Text", &ustrl);
     buf->filename = ustr;
@@ -348,6 +881,7 @@ void init_help_buffer(Buffer* buf) {
                        "Ctrl-O:       Open a new file\n"
                        "Ctrl-'-':     Decrease font size\n"
                        "Ctrl-'+':     Increase font size\n"
+                       "Ctrl-Wheel:   Change font size\n"
                        "Ctrl-L:       Enable/Disable line counter\n"
                        "Hold Shift:   Create a selection\n"
                        "Ctrl-Q:       Select a line\n"
@@ -362,39 +896,49 @@ void init_help_buffer(Buffer* buf) {
                        "              (save/open/help)\n\n"
                        "Open %localappdata%\\txt\\config.txt or ~/.config/txt/config.txt to\n"
                        "change color scheme";
-    ustr = LoadCodepoints(hstr, &ustrl);
-    for (int i = 0; i < ustrl; ++i) da_push(buf->content, ustr[i]);
+    size_t hstrl = strlen(hstr);
+    char* content = malloc(hstrl);
+    memcpy(content, hstr, hstrl);
+    text_init_from(&buf->text, content, hstrl);
 
-    update_newlines(buf);
     color_highlight(buf);
 }
 
 void init_buf(Buffer* buf) {
-    buf->selection_origin = -1;
-    buf->lines = da_new(Line);
-    buf->content = da_new(int);
+    buf->has_selection = false;
+    text_init(&buf->text);
     buf->tokens = da_new(Token);
     buf->search_buffer = da_new(int);
-    update_newlines(buf);
     color_highlight(buf);
 }
 
+void buf_load_stop(Buffer* buf);
+bool buf_index(Buffer* buf);
+
 void deinit_buf(Buffer* buf) {
-    buf->selection_origin = -1;
-    da_free(buf->lines);
-    da_free(buf->content);
+    buf_load_stop(buf);
+    hl_stop(buf);
+    buf->has_selection = false;
+    text_free(&buf->text);
     da_free(buf->tokens);
+    if (buf->hl_states) da_free(buf->hl_states);
+    buf->hl_states = 0;
+    if (buf->hl_offsets) da_free(buf->hl_offsets);
+    buf->hl_offsets = 0;
+    buf->language = LANGUAGE_NONE;
     da_free(buf->search_buffer);
     buf->changed = false;
+    buf->readonly = false;
+    buf->cursor_cache.valid = false;
+    buf->selection_cache.valid = false;
     if (buf->filename != 0) free(buf->filename);
 }
 
 void init_open_buffer(Buffer* buf) {
-    buf->selection_origin = -1;
-    buf->lines = da_new(Line);
-    buf->content = da_new(int);
+    buf->has_selection = false;
     buf->tokens = da_new(Token);
     buf->search_buffer = da_new(int);
+    int* content = da_new(int);
     int ustrl = 0;
     int* ustr = LoadCodepoints("Open a file...", &ustrl);
     buf->filename = ustr;
@@ -406,15 +950,15 @@ void init_open_buffer(Buffer* buf) {
     int ucwdl;
     int* ucwd = LoadCodepoints(path, &ucwdl);
     for (int j = 0; j < ucwdl; ++j) {
-        da_push(buf->content, ucwd[j]);
+        da_push(content, ucwd[j]);
     }
     UnloadCodepoints(ucwd);
-    da_push(buf->content, '\n');
-    da_push(buf->content, '\n');
+    da_push(content, '\n');
+    da_push(content, '\n');
     
-    da_push(buf->content, '.');
-    da_push(buf->content, '.');
-    da_push(buf->content, '\n');
+    da_push(content, '.');
+    da_push(content, '.');
+    da_push(content, '\n');
     
     for (size_t i = 0; i < files.count; ++i) {
         if (DirectoryExists(files.paths[i])) {
@@ -422,10 +966,10 @@ void init_open_buffer(Buffer* buf) {
             int fl;
             int* fs = LoadCodepoints(str, &fl);
             for (int j = 0; j < fl; ++j) {
-                da_push(buf->content, fs[j]);
+                da_push(content, fs[j]);
             }
-            da_push(buf->content, '/');
-            da_push(buf->content, '\n');
+            da_push(content, '/');
+            da_push(content, '\n');
         }
     }
 
@@ -435,17 +979,20 @@ void init_open_buffer(Buffer* buf) {
             int fl;
             int* fs = LoadCodepoints(str, &fl);
             for (int j = 0; j < fl; ++j) {
-                da_push(buf->content, fs[j]);
+                da_push(content, fs[j]);
             }
-            da_push(buf->content, '\n');
+            da_push(content, '\n');
         }
     }
 
-    da_pop(buf->content, 0);
+    da_pop(content, 0);
 
     UnloadDirectoryFiles(files);
 
-    update_newlines(buf);
+    text_init(&buf->text);
+    text_insert(&buf->text, 0, content, da_length(content));
+    da_free(content);
+
     color_highlight(buf);
 }
 
@@ -456,88 +1003,253 @@ void init_save_buffer(Buffer* buf) {
     buf->filename = ustr;
     buf->filenamel = ustrl;
     
-    update_newlines(buf);
     color_highlight(buf);
 }
 
+// Inserts N codepoints at OFFSET in one go. The cursor and the selection
+// origin move along if they are behind it.
+void insert_range(Buffer* buf, size_t offset, const int* codepoints, size_t n) {
+    if (n == 0) return;
+    size_t line = text_line_of(&buf->text, offset);
+    size_t lines = buf_line_count(buf);
+    text_insert(&buf->text, offset, codepoints, n);
+    buf_lines_changed(buf, line, 0, buf_line_count(buf) - lines);
+    if (buf->has_selection && buf->selection_origin > offset) buf->selection_origin += n;
+    if (buf->cursor >= offset) buf->cursor += n;
+}
+
+// Removes codepoints [START, END). The cursor and the selection origin are
+// pulled back so they keep pointing at the same text, or at START if it was
+// deleted.
+void delete_range(Buffer* buf, size_t start, size_t end) {
+    if (end > text_length(&buf->text)) end = text_length(&buf->text);
+    if (start >= end) return;
+    size_t line = text_line_of(&buf->text, start);
+    size_t lines = buf_line_count(buf);
+    text_delete(&buf->text, start, end);
+    buf_lines_changed(buf, line, lines - buf_line_count(buf), 0);
+    if (buf->cursor >= end) buf->cursor -= end - start;
+    else if (buf->cursor > start) buf->cursor = start;
+    if (buf->has_selection) {
+        size_t origin = buf->selection_origin;
+        if (origin >= end) buf->selection_origin -= end - start;
+        else if (origin > start) buf->selection_origin = start;
+    }
+}
+
 void push_at_cursor(Buffer* buf, int charachter) {
-    da_push(buf->content, 0);
-    memcpy(buf->content + buf->cursor + 1, buf->content + buf->cursor, (da_length(buf->content) - 1 - buf->cursor)*sizeof(int));
-    buf->content[buf->cursor] = charachter;
-    if ((size_t) buf->selection_origin > buf->cursor && buf->selection_origin != -1) buf->selection_origin++;
-    buf->cursor++;
+    insert_range(buf, buf->cursor, &charachter, 1);
 }
 
 void push_cstr_at_cursor(Buffer* buf, char* string) {
-    size_t length = strlen(string);
-    for (size_t i = 0; i < length; ++i) {
-        push_at_cursor(buf, string[i]);
+    int length;
+    int* codepoints = LoadCodepoints(string, &length);
+    insert_range(buf, buf->cursor, codepoints, length);
+    UnloadCodepoints(codepoints);
+}
+
+// Writes the whole text to PATH. Sets ERROR and returns false if it can't.
+bool buf_write(Buffer* buf, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        error = strerror(errno);
+        return false;
     }
+    TextIter it;
+    char* span;
+    size_t n;
+    bool ok = true;
+    text_iter_init(&buf->text, &it, 0, text_length(&buf->text));
+    while (ok && text_iter_next(&it, &span, &n, 0)) ok = fwrite(span, 1, n, f) == n;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) error = strerror(errno);
+    return ok;
 }
 
 void save_file(Buffer* buf) {
-    char* utf8_string = LoadUTF8(buf->content, da_length(buf->content));
+    if (buf->readonly) {
+        error = "File is open read-only";
+        return;
+    }
+    if (buf->loader) {
+        error = "File is still loading";
+        return;
+    }
     char* ufilename = LoadUTF8(buf->filename, buf->filenamel);
-    FILE* f = fopen(ufilename, "w");
-    if (f == NULL) {
-        error = strerror(errno);
+#ifndef _WIN32
+    // A mapped file is still the original buffer of the text, so it can't
+    // be truncated and written over. The text goes to a file next to it
+    // that then replaces it, and the mapping keeps the old one alive.
+    if (buf->text.mapped) {
+        while (buf_index(buf));
+        char* tmp = malloc(strlen(ufilename) + 8);
+        sprintf(tmp, "%s.XXXXXX", ufilename);
+        int fd = mkstemp(tmp);
+        struct stat st;
+        bool ok = fd >= 0;
+        if (!ok) error = strerror(errno);
+        else {
+            if (stat(ufilename, &st) == 0) fchmod(fd, st.st_mode & 07777);
+            close(fd);
+            ok = buf_write(buf, tmp);
+            if (ok && rename(tmp, ufilename) != 0) {
+                error = strerror(errno);
+                ok = false;
+            }
+            if (!ok) unlink(tmp);
+        }
+        free(tmp);
+        UnloadUTF8(ufilename);
+        if (ok) buf->changed = false;
         return;
     }
-    size_t utf8l = strlen(utf8_string);
-    fwrite(utf8_string, 1, utf8l, f);
-    UnloadUTF8(utf8_string);
-    fclose(f);
+#endif
+    bool ok = buf_write(buf, ufilename);
     UnloadUTF8(ufilename);
-    buf->changed = false;
+    if (ok) buf->changed = false;
 }
 
 void remove_selection(Buffer* buf) {
-    size_t start = buf->cursor;
-    size_t end = buf->selection_origin;
-    if (start > end) {
-        start = buf->selection_origin;
-        end = buf->cursor;
+    size_t start, end;
+    if (!buf_get_selection(buf, &start, &end)) return;
+    delete_range(buf, start, end);
+    buf->has_selection = false;
+}
+
+void* buf_load_worker(void* arg) {
+    Loader* loader = arg;
+    char* raw = malloc(BUF_LOAD_CHUNK + 4);
+    size_t carried = 0;
+    while (true) {
+        size_t n = fread(raw + carried, 1, BUF_LOAD_CHUNK, loader->file);
+        size_t total = carried + n;
+        bool done = n == 0;
+        // Keep a codepoint that might be cut off for the next round.
+        size_t cut = total;
+        if (!done) {
+            for (size_t i = total; i > 0 && total - i < 4; --i) {
+                if (!text_utf8_continuation(raw[i-1])) { cut = i-1; break; }
+            }
+        }
+        size_t tabs = 0;
+        for (size_t i = 0; i < cut; ++i) if (raw[i] == '\t') tabs++;
+        LoadChunk chunk = {malloc(cut + tabs*3 + 1), 0};
+        for (size_t i = 0; i < cut; ++i) {
+            if (raw[i] == '\t') {
+                memcpy(chunk.data + chunk.bytes, "    ", 4);
+                chunk.bytes += 4;
+            } else chunk.data[chunk.bytes++] = raw[i];
+        }
+        carried = total - cut;
+        memmove(raw, raw + cut, carried);
+
+        pthread_mutex_lock(&loader->lock);
+        bool cancel = loader->cancel;
+        if (!cancel && chunk.bytes > 0) da_push(loader->chunks, chunk);
+        else free(chunk.data);
+        loader->read += n;
+        if (done) loader->finished = true;
+        pthread_mutex_unlock(&loader->lock);
+        if (done || cancel) break;
     }
-    size_t len = da_length(buf->content)-end;
-    int temp[len];
-    memcpy(temp, buf->content + end, sizeof(int)*len);
-    memcpy(buf->content + start, temp, sizeof(int)*len);
-    for (size_t i = 0; i < end-start; ++i) da_pop(buf->content, 0);
-    buf->selection_origin = -1;
-    buf->cursor = start;
+    free(raw);
+    return 0;
 }
 
 void init_buf_from_file(Buffer* buf, char* fname) {
     int ufnl;
     buf->filename = LoadCodepoints(fname, &ufnl);
     buf->filenamel = ufnl;
-    buf->selection_origin = -1;
-    buf->lines = da_new(Line);
-    buf->content = da_new(int);
+    buf->has_selection = false;
     buf->search_buffer = da_new(int);
     buf->tokens = da_new(Token);
+    if (text_init_mapped(&buf->text, fname, BUF_MAP_SIZE)) {
+        text_index(&buf->text, BUF_INDEX_BUDGET);
+        color_highlight(buf);
+        return;
+    }
+    text_free(&buf->text);
+    text_init(&buf->text);
     FILE* f = fopen(fname, "r");
     if (f == NULL) {
         error = strerror(errno);
         return;
     }
-    size_t size = GetFileLength(fname);
-    char* file = malloc(size+1);
-    file[size] = '\0';
-    fread(file, 1, size, f);
-    int fs;
-    int* uf = LoadCodepoints(file, &fs);
-    free(file);
-    for (int i = 0; i < fs; ++i) {
-        if (uf[i] == '\t') {
-            da_push(buf->content, ' ');
-            da_push(buf->content, ' ');
-            da_push(buf->content, ' ');
-            da_push(buf->content, ' ');
-        } else da_push(buf->content, uf[i]);
-    }
-    if (fs != 0) UnloadCodepoints(uf);
-    fclose(f);
-    update_newlines(buf);
+    // GetFileLength is an int, and 0 past 2 GB.
+    struct stat st;
+    Loader* loader = calloc(1, sizeof(Loader));
+    loader->file = f;
+    if (fstat(fileno(f), &st) == 0) loader->size = st.st_size;
+    loader->chunks = da_new(LoadChunk);
+    pthread_mutex_init(&loader->lock, 0);
+    buf->loader = loader;
+    pthread_create(&loader->thread, 0, buf_load_worker, loader);
     color_highlight(buf);
 }
+
+// Moves the chunks read so far into the buffer. Returns true while the
+// file is still loading.
+bool buf_load_poll(Buffer* buf) {
+    Loader* loader = buf->loader;
+    if (loader == 0) return false;
+    pthread_mutex_lock(&loader->lock);
+    LoadChunk* chunks = loader->chunks;
+    loader->chunks = da_new(LoadChunk);
+    bool finished = loader->finished;
+    pthread_mutex_unlock(&loader->lock);
+    size_t lines = buf_line_count(buf);
+    for (size_t i = 0; i < da_length(chunks); ++i) {
+        text_append_block(&buf->text, chunks[i].data, chunks[i].bytes);
+    }
+    if (da_length(chunks) > 0) buf_lines_changed(buf, lines - 1, 0, buf_line_count(buf) - lines);
+    da_free(chunks);
+    if (finished) buf_load_stop(buf);
+    return !finished;
+}
+
+// Indexes the next BUF_INDEX_BUDGET bytes of a mapped file. Returns true
+// while some of it is still left.
+bool buf_index(Buffer* buf) {
+    if (!buf->text.mapped) return false;
+    size_t lines = buf_line_count(buf);
+    bool more = text_index(&buf->text, BUF_INDEX_BUDGET);
+    if (buf_line_count(buf) > lines) buf_lines_changed(buf, lines - 1, 0, buf_line_count(buf) - lines);
+    return more;
+}
+
+// Fraction of the file loaded so far.
+float buf_load_progress(Buffer* buf) {
+    Loader* loader = buf->loader;
+    if (loader == 0 || loader->size == 0) return 1;
+    pthread_mutex_lock(&loader->lock);
+    float progress = loader->read / (float) loader->size;
+    pthread_mutex_unlock(&loader->lock);
+    return progress;
+}
+
+// Stops the worker and drops whatever it hasn't handed over yet.
+void buf_load_stop(Buffer* buf) {
+    Loader* loader = buf->loader;
+    if (loader == 0) return;
+    pthread_mutex_lock(&loader->lock);
+    loader->cancel = true;
+    pthread_mutex_unlock(&loader->lock);
+    pthread_join(loader->thread, 0);
+    for (size_t i = 0; i < da_length(loader->chunks); ++i) free(loader->chunks[i].data);
+    da_free(loader->chunks);
+    pthread_mutex_destroy(&loader->lock);
+    fclose(loader->file);
+    free(loader);
+    buf->loader = 0;
+}
+
+// Keeps what is loaded and stops there. The rest of the file is missing,
+// so the buffer turns read-only to keep it from being saved over the file.
+void buf_load_cancel(Buffer* buf) {
+    if (buf->loader == 0) return;
+    buf_load_poll(buf);
+    if (buf->loader == 0) return;
+    buf_load_stop(buf);
+    buf->readonly = true;
+    error = "Loading cancelled";
+}
@@ -1,5 +1,6 @@
 
 #include <raylib.h>
+#include <stdint.h>
 #include <stdio.h>
 
 // #define BACKGROUND   (Color){18,  18,  18,  255}
@@ -27,6 +28,21 @@ Color STRING = {0};
 Color ERROR = {0};
 Color PREPROCESSOR = {0};
 
+// Token classes the highlighter hands out, each one indexes PALETTE.
+// Changing a color in place recolors every token without re-lexing.
+#define TOKEN_DEFAULT      0
+#define TOKEN_COMMENT      1
+#define TOKEN_NUMBER       2
+#define TOKEN_KWORD        3
+#define TOKEN_STRING       4
+#define TOKEN_ERROR        5
+#define TOKEN_PREPROCESSOR 6
+
+Color* PALETTE[] = {&DEFAULT, &COMMENT, &NUMBER, &KWORD, &STRING, &ERROR, &PREPROCESSOR};
+
+// Lines highlighted above and below the visible ones.
+int HL_MARGIN = 0;
+
 Color BACKGROUND_A(int alpha) {return (Color) {BACKGROUND.r, BACKGROUND.g, BACKGROUND.b, alpha};};
 Color FOREGROUND_A(int alpha) {return (Color) {FOREGROUND.r, FOREGROUND.g, FOREGROUND.b, alpha};};
 Color MIDDLEGROUND_A(int alpha) {return (Color) {MIDDLEGROUND.r, MIDDLEGROUND.g, MIDDLEGROUND.b, alpha};};
@@ -123,6 +139,7 @@ void load_config() {
     STRING       = (Color){252, 167, 162, 255};
     ERROR        = (Color){255, 0,   0,   255};
     PREPROCESSOR = (Color){218, 181, 255, 255};
+    HL_MARGIN = 100;
     load_cfg_path();
     if (!FileExists(config_path)) {
         char dname[strlen(config_path)+1];
@@ -140,7 +157,8 @@ void load_config() {
                               "KWORD        252 237 162\n"
                               "STRING       252 167 162\n"
                               "ERROR        255 0   0\n"
-                              "PREPROCESSOR 218 181 255";
+                              "PREPROCESSOR 218 181 255\n"
+                              "HL_MARGIN    100\n";
         fwrite(defconf, 1, strlen(defconf), fw);
         fclose(fw);
     }
@@ -164,7 +182,7 @@ void load_config() {
             char name[16], r[16], g[16], b[16];
             int state = 0;
             while (state < 4) {
-                while (isspace(conf[i])) {
+                while (isspace(conf[i]) && conf[i] != '\n') {
                     i++;
                 }
                 int length = 0;
@@ -201,6 +219,8 @@ void load_config() {
             if (strncmp(name, "STRING", 16) == 0) STRING = (Color) {rn, gn, bn, 255};
             if (strncmp(name, "ERROR", 16) == 0) ERROR = (Color) {rn, gn, bn, 255};
             if (strncmp(name, "PREPROCESSOR", 16) == 0) PREPROCESSOR = (Color) {rn, gn, bn, 255};
+            // A negative margin would wrap around in the window arithmetic.
+            if (strncmp(name, "HL_MARGIN", 16) == 0) HL_MARGIN = rn > 0 ? rn : 0;
 
             start = end + 1;
         }
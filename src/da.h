@@ -64,10 +64,13 @@ void da_pop(void* array, void* toptr);
 void da_free(void* array);
 // -> Destroy and free the array
 
+void* da_splice(void* array, size_t at, size_t remove, void* items, size_t count);
+// -> Replace REMOVE items at AT with COUNT items from ITEMS, or with zeroes if ITEMS is null. Returns the array.
+
 #ifdef DA_IMPL
 
 void* _da_new(size_t capacity, size_t stride) {
-    int size = sizeof(size_t) * DA_FIELDS + capacity*stride;
+    size_t size = sizeof(size_t) * DA_FIELDS + capacity*stride;
     size_t* array = malloc(size);
     array[DA_STRIDE] = stride;
     array[DA_LENGTH] = 0;
@@ -117,6 +120,25 @@ void* da_push_many(void* array, void* items, size_t count) {
     return array;
 }
 
+void* da_splice(void* array, size_t at, size_t remove, void* items, size_t count) {
+    size_t length = da_length(array);
+    size_t stride = da_stride(array);
+    size_t new_length = length - remove + count;
+    if (new_length > da_capacity(array)) {
+        size_t capacity = da_capacity(array);
+        while (capacity < new_length) capacity *= 2;
+        void* temp = _da_new(capacity, stride);
+        memcpy(temp, array, length * stride);
+        da_free(array);
+        array = temp;
+    }
+    memmove(array + (at + count)*stride, array + (at + remove)*stride, (length - at - remove)*stride);
+    if (items != 0) memcpy(array + at*stride, items, count*stride);
+    else memset(array + at*stride, 0, count*stride);
+    _da_set(array, DA_LENGTH, new_length);
+    return array;
+}
+
 #endif // DA_IMPL
 
 #endif // DA_H_
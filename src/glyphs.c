@@ -0,0 +1,257 @@
+// Glyphs of the font at one size. Printable ASCII is rasterized up front,
+// everything else from the TTF the first time it is measured or drawn.
+// Bitmaps live in square cells of a few atlas textures, and once those are
+// full the least recently drawn glyph gives up its cell. Codepoints are
+// looked up in tables of our own, raylib's GetGlyphIndex is a linear
+// search and its text functions take UTF-8.
+
+#include "rlgl.h"
+
+// Pages of the BMP in the lookup table, 256 codepoints each.
+#define GLYPH_PAGES 256
+// Atlas textures are GRAY_ALPHA, 2 MB each at this size.
+#define GLYPH_ATLAS_SIZE 1024
+#define GLYPH_ATLAS_PAGES 4
+// Transparent border around each bitmap in its cell.
+#define GLYPH_PAD 2
+
+typedef struct {
+    int codepoint;
+    float advance;
+    int offset_x;
+    int offset_y;
+    int width;
+    int height;
+    // Cell of the bitmap in the atlas, -1 when it was evicted.
+    int cell;
+} Glyph;
+
+typedef struct {
+    int codepoint;
+    int glyph;
+} GlyphSlot;
+
+typedef struct {
+    int glyph;
+    size_t used;
+} GlyphCell;
+
+typedef struct {
+    const unsigned char* ttf;
+    int ttf_size;
+    int size;
+    Glyph* glyphs;
+    // Index in GLYPHS of BMP codepoint C is PAGES[C >> 8][C & 255], -1 if
+    // it wasn't needed yet. Codepoints past the BMP are in the open
+    // addressed SLOTS, MASK + 1 of them, empty ones have codepoint 0.
+    int* pages[GLYPH_PAGES];
+    GlyphSlot* slots;
+    unsigned int mask;
+    unsigned int slot_count;
+    // Cells are handed out in order until all GLYPH_ATLAS_PAGES textures
+    // are used, then taken from the glyph with the oldest USED.
+    Texture2D atlas[GLYPH_ATLAS_PAGES];
+    int atlas_count;
+    int cell_size;
+    int cells_per_row;
+    int cells_per_atlas;
+    GlyphCell* cells;
+    int cell_count;
+    size_t tick;
+    // Glyph drawn for control characters, '?' like in raylib.
+    int fallback;
+    // The advance of all of printable ASCII, if they have the same one.
+    float monospace;
+} Glyphs;
+
+unsigned int glyph_hash(int c) {
+    return (unsigned int) c * 2654435761u >> 7;
+}
+
+// Copies the bitmap of glyph I into a cell, evicting the least recently
+// drawn glyph when there are no free ones. Bitmaps bigger than a cell are
+// cut off.
+void glyph_place(Glyphs* g, int i, Image image) {
+    int cell;
+    if (g->cell_count < g->atlas_count*g->cells_per_atlas) {
+        cell = g->cell_count++;
+    } else if (g->atlas_count < GLYPH_ATLAS_PAGES) {
+        Image blank = {calloc(GLYPH_ATLAS_SIZE*GLYPH_ATLAS_SIZE, 2), GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE,
+                       1, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+        g->atlas[g->atlas_count++] = LoadTextureFromImage(blank);
+        free(blank.data);
+        g->cells = realloc(g->cells, g->atlas_count*g->cells_per_atlas*sizeof(GlyphCell));
+        cell = g->cell_count++;
+    } else {
+        cell = 0;
+        for (int k = 1; k < g->cell_count; ++k) {
+            if (g->cells[k].used < g->cells[cell].used) cell = k;
+        }
+        g->glyphs[g->cells[cell].glyph].cell = -1;
+    }
+    g->cells[cell] = (GlyphCell) {i, g->tick};
+    g->glyphs[i].cell = cell;
+
+    int side = g->cell_size;
+    int width = image.width < side - 2*GLYPH_PAD ? image.width : side - 2*GLYPH_PAD;
+    int height = image.height < side - 2*GLYPH_PAD ? image.height : side - 2*GLYPH_PAD;
+    if (image.data == 0) width = height = 0;
+    g->glyphs[i].width = width;
+    g->glyphs[i].height = height;
+    unsigned char* pixels = calloc(side*side, 2);
+    for (int k = 0; k < side*side; ++k) pixels[2*k] = 255;
+    const unsigned char* gray = image.data;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            pixels[2*((y + GLYPH_PAD)*side + x + GLYPH_PAD) + 1] = gray[y*image.width + x];
+        }
+    }
+    int in_atlas = cell % g->cells_per_atlas;
+    Rectangle rec = {in_atlas % g->cells_per_row * side, in_atlas / g->cells_per_row * side, side, side};
+    // Glyphs already in the batch may sample the cell being replaced.
+    rlDrawRenderBatchActive();
+    UpdateTextureRec(g->atlas[cell / g->cells_per_atlas], rec, pixels);
+    free(pixels);
+}
+
+int glyph_slot(const Glyphs* g, int c) {
+    unsigned int h = glyph_hash(c) & g->mask;
+    while (g->slots[h].codepoint != 0 && g->slots[h].codepoint != c) h = (h + 1) & g->mask;
+    return h;
+}
+
+// Rasterizes the COUNT codepoints at CODEPOINTS, which aren't known yet.
+void glyph_rasterize(Glyphs* g, int* codepoints, int count) {
+    GlyphInfo* info = LoadFontData(g->ttf, g->ttf_size, g->size, codepoints, count, FONT_DEFAULT);
+    // A TTF that doesn't load gets empty glyphs.
+    if (info == 0) info = calloc(count, sizeof(GlyphInfo));
+    for (int k = 0; k < count; ++k) {
+        int c = codepoints[k];
+        Glyph glyph = {c, info[k].advanceX, info[k].offsetX, info[k].offsetY, 0, 0, -1};
+        if (glyph.advance == 0) glyph.advance = info[k].image.width + info[k].offsetX;
+        int i = da_length(g->glyphs);
+        da_push(g->glyphs, glyph);
+        if (c < 0x10000) {
+            int** page = &g->pages[c >> 8];
+            if (*page == 0) {
+                *page = malloc(256*sizeof(int));
+                for (int p = 0; p < 256; ++p) (*page)[p] = -1;
+            }
+            (*page)[c & 255] = i;
+        } else {
+            if (2*(g->slot_count + 1) > g->mask + 1) {
+                GlyphSlot* old = g->slots;
+                unsigned int size = old ? 2*(g->mask + 1) : 64;
+                g->slots = calloc(size, sizeof(GlyphSlot));
+                g->mask = size - 1;
+                for (unsigned int h = 0; old && h < size/2; ++h) {
+                    if (old[h].codepoint != 0) g->slots[glyph_slot(g, old[h].codepoint)] = old[h];
+                }
+                free(old);
+            }
+            g->slots[glyph_slot(g, c)] = (GlyphSlot) {c, i};
+            g->slot_count++;
+        }
+        glyph_place(g, i, info[k].image);
+    }
+    UnloadFontData(info, count);
+}
+
+// Index of the glyph for codepoint C, rasterizing it if it's new.
+int glyph_find(Glyphs* g, int c) {
+    if (c < 32 || c > 0x10FFFF) return g->fallback;
+    int i = -1;
+    if (c < 0x10000) {
+        if (g->pages[c >> 8]) i = g->pages[c >> 8][c & 255];
+    } else if (g->slots) {
+        GlyphSlot* slot = &g->slots[glyph_slot(g, c)];
+        if (slot->codepoint == c) i = slot->glyph;
+    }
+    if (i < 0) {
+        i = da_length(g->glyphs);
+        glyph_rasterize(g, &c, 1);
+    }
+    return i;
+}
+
+// Glyphs of the TTF data at TTF, which has to outlive them, at SIZE.
+Glyphs glyphs_init(const unsigned char* ttf, int ttf_size, int size) {
+    Glyphs g = {0};
+    g.ttf = ttf;
+    g.ttf_size = ttf_size;
+    g.size = size;
+    g.glyphs = da_new(Glyph);
+    g.cell_size = size*3/2 + 2*GLYPH_PAD;
+    g.cells_per_row = GLYPH_ATLAS_SIZE/g.cell_size;
+    g.cells_per_atlas = g.cells_per_row*g.cells_per_row;
+
+    int ascii[95];
+    for (int c = 32; c < 127; ++c) ascii[c - 32] = c;
+    glyph_rasterize(&g, ascii, 95);
+    g.fallback = glyph_find(&g, '?');
+    g.monospace = g.glyphs[0].advance;
+    for (int i = 0; i < 95; ++i) {
+        if (g.glyphs[i].advance != g.monospace) g.monospace = 0;
+    }
+    return g;
+}
+
+void glyphs_unload(Glyphs* g) {
+    for (int p = 0; p < GLYPH_PAGES; ++p) free(g->pages[p]);
+    for (int a = 0; a < g->atlas_count; ++a) UnloadTexture(g->atlas[a]);
+    free(g->slots);
+    free(g->cells);
+    da_free(g->glyphs);
+}
+
+float glyph_advance(Glyphs* g, int c) {
+    // Finding it may grow GLYPHS.
+    int i = glyph_find(g, c);
+    return g->glyphs[i].advance;
+}
+
+// Draws codepoint C with its top left at POSITION, the way
+// DrawTextCodepoint does.
+void glyph_draw(Glyphs* g, int c, Vector2 position, Color tint) {
+    int i = glyph_find(g, c);
+    if (g->glyphs[i].cell < 0) {
+        int codepoint = g->glyphs[i].codepoint;
+        GlyphInfo* info = LoadFontData(g->ttf, g->ttf_size, g->size, &codepoint, 1, FONT_DEFAULT);
+        if (info == 0) info = calloc(1, sizeof(GlyphInfo));
+        glyph_place(g, i, info[0].image);
+        UnloadFontData(info, 1);
+    }
+    Glyph* glyph = &g->glyphs[i];
+    g->cells[glyph->cell].used = ++g->tick;
+    int in_atlas = glyph->cell % g->cells_per_atlas;
+    Rectangle src = {in_atlas % g->cells_per_row * g->cell_size, in_atlas / g->cells_per_row * g->cell_size,
+                     glyph->width + 2*GLYPH_PAD, glyph->height + 2*GLYPH_PAD};
+    Rectangle dst = {position.x + glyph->offset_x - GLYPH_PAD, position.y + glyph->offset_y - GLYPH_PAD,
+                     src.width, src.height};
+    DrawTexturePro(g->atlas[glyph->cell / g->cells_per_atlas], src, dst, (Vector2) {0, 0}, 0, tint);
+}
+
+// Width of the N bytes of UTF-8 at S.
+float glyphs_measure_utf8(Glyphs* g, const char* s, size_t n) {
+    float width = 0;
+    for (size_t i = 0; i < n;) {
+        int size;
+        width += glyph_advance(g, text_utf8_decode(s + i, n - i, &size));
+        i += size;
+    }
+    return width;
+}
+
+// Draws the string S on one line from POSITION, returns its width.
+float glyphs_draw_utf8(Glyphs* g, const char* s, Vector2 position, Color tint) {
+    size_t n = strlen(s);
+    float x = position.x;
+    for (size_t i = 0; i < n;) {
+        int size;
+        int c = text_utf8_decode(s + i, n - i, &size);
+        i += size;
+        if (c != ' ' && c != '\t') glyph_draw(g, c, (Vector2) {x, position.y}, tint);
+        x += glyph_advance(g, c);
+    }
+    return x - position.x;
+}
@@ -0,0 +1,468 @@
+// Language definitions. They are read from the .lang files next to
+// config.txt and compiled into a character class table and a state
+// transition table, which the lexer in buffer.c runs on, plus the sets of
+// characters that keep each kind of token going, which it skips over with
+// vector instructions.
+
+#include <stdbool.h>
+
+typedef struct {
+    const char* word;
+    int length;
+} Keyword;
+
+// Perfect hash table, every word has a slot of its own.
+typedef struct {
+    unsigned int seed;
+    unsigned int mask;
+    int max_length;
+    Keyword* table;
+} KeywordSet;
+
+#define LANG_WORD 64
+#define LANG_DELIM 8
+#define LANG_STRINGS 4
+// Characters lang_run looks at one at a time before using vectors.
+#define LANG_SCALAR 8
+
+// Lexer states within a line, the rows of the transition table.
+#define LX_CODE 0
+#define LX_IDENT 1
+#define LX_NUMBER 2
+#define LX_COMMENT 3
+#define LX_STRING 4
+#define LX_STATES (LX_STRING + LANG_STRINGS)
+
+// What a character class does in a state. In LX_CODE it starts a token, in
+// the others it keeps the token going or ends it.
+#define LX_OTHER 0
+#define LX_START_IDENT 1
+#define LX_START_NUMBER 2
+#define LX_STAY 3
+#define LX_END 4
+#define LX_ESCAPE 5
+#define LX_CLOSE 6
+#define LX_CHECK 7
+
+// Set of ASCII characters as two tables indexed by the low and the high
+// nibble of a byte. A byte is in the set when the two entries share a bit,
+// which takes a shuffle each to test for 16 or 32 bytes at once.
+typedef struct {
+    unsigned char low[16];
+    unsigned char high[16];
+} LangRun;
+
+typedef struct {
+    char name[32];
+    char** extensions;
+    char** words;
+    KeywordSet keywords;
+    char line_comment[LANG_DELIM];
+    char block_start[LANG_DELIM];
+    char block_end[LANG_DELIM];
+    char strings[LANG_STRINGS + 1];
+    char escape;
+    char preprocessor;
+    char preprocessor_string[3];
+    // Characters below 256 that act the same everywhere share a class.
+    // Codepoints above are letters in LETTER_CLASS unless they're spaces
+    // or punctuation, which go in class 0 with NUL. DELIMITER marks the
+    // classes that may start a comment, string or preprocessor directive.
+    unsigned char classes[256];
+    unsigned char letter_class;
+    int class_count;
+    bool delimiter[256];
+    unsigned char table[LX_STATES][256];
+    // The classes each state stays in, where LX_CODE stays in the ones
+    // that are tokens of their own, and the ASCII characters among them.
+    bool stays[LX_STATES][256];
+    LangRun runs[LX_STATES];
+} Language;
+
+Language* languages;
+bool lang_avx2;
+bool lang_ssse3;
+
+// Whether codepoint C, which is past ASCII, can be part of an identifier.
+// Only the spaces and punctuation blocks are left out, there is no table
+// of the letters.
+bool lang_letter(int c) {
+    if (c < 256) return (c >= 0xC0 && c != 0xD7 && c != 0xF7) || c == 0xAA || c == 0xB5 || c == 0xBA;
+    return !(c >= 0x2000 && c < 0x2070) && !(c >= 0x3000 && c < 0x3040) && c != 0xFEFF;
+}
+
+#define LANGUAGE_CLASS(lang, c) ((unsigned int) (c) < 256 ? (lang)->classes[(c)] : \
+                                 lang_letter(c) ? (lang)->letter_class : 0)
+
+const char* default_languages[][2] = {
+    {"c.lang",
+     "NAME          C\n"
+     "EXTENSIONS    .c .h\n"
+     "KEYWORDS      auto break case char const continue default do double else enum extern\n"
+     "KEYWORDS      float for goto if int long register return short signed sizeof static\n"
+     "KEYWORDS      struct switch typedef union unsigned void volatile while alignas alignof\n"
+     "KEYWORDS      and and_eq asm atomic_cancel atomic_commit atomic_noexcept bitand bitor\n"
+     "KEYWORDS      bool catch char16_t char32_t char8_t class co_await co_return co_yield\n"
+     "KEYWORDS      compl concept const_cast consteval constexpr constinit decltype delete\n"
+     "KEYWORDS      dynamic_cast explicit export false friend inline mutable namespace new\n"
+     "KEYWORDS      noexcept not not_eq nullptr operator or or_eq private protected public\n"
+     "KEYWORDS      reflexpr reinterpret_cast requires static_assert static_cast synchronized\n"
+     "KEYWORDS      template this thread_local throw true try typeid typename using virtual\n"
+     "KEYWORDS      wchar_t xor xor_eq\n"
+     "LINE_COMMENT  //\n"
+     "BLOCK_COMMENT /* */\n"
+     "STRING        \" '\n"
+     "ESCAPE        \\\n"
+     "PREPROCESSOR  #\n"
+     "PREPROCESSOR_STRING < >\n"
+     "NUMBER_START  0123456789\n"
+     "NUMBER        0123456789xlL.abcdefABCDEF\n"},
+    {"py.lang",
+     "NAME          Python\n"
+     "EXTENSIONS    .py\n"
+     "KEYWORDS      and as assert break class continue def del elif else except False\n"
+     "KEYWORDS      finally from global if import in is lambda None nonlocal not or pass\n"
+     "KEYWORDS      raise return True try while with yield\n"
+     "LINE_COMMENT  #\n"
+     "STRING        \" '\n"
+     "ESCAPE        \\\n"
+     "NUMBER_START  0123456789\n"
+     "NUMBER        0123456789xob.eEjJabcdefABCDEF_\n"},
+};
+
+unsigned int keyword_hash(const int* s, int length, unsigned int seed) {
+    unsigned int h = seed ^ length;
+    for (int i = 0; i < length; ++i) h = (h ^ s[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+unsigned int keyword_hash_word(const char* word, unsigned int seed) {
+    int s[LANG_WORD];
+    int length = strlen(word);
+    for (int i = 0; i < length; ++i) s[i] = (unsigned char) word[i];
+    return keyword_hash(s, length, seed);
+}
+
+// Whether the codepoints S[0..LENGTH) are one of SET's words.
+bool keyword_find(const KeywordSet* set, const int* s, int length) {
+    if (set->table == 0 || length > set->max_length) return false;
+    const Keyword* k = &set->table[keyword_hash(s, length, set->seed) & set->mask];
+    if (k->length != length) return false;
+    for (int i = 0; i < length; ++i) {
+        if (s[i] != (unsigned char) k->word[i]) return false;
+    }
+    return true;
+}
+
+// Looks for a seed that gives each of WORDS a slot of its own, and doubles
+// the table when none does.
+void keyword_build(KeywordSet* set, char** words) {
+    int count = da_length(words);
+    set->table = 0;
+    set->max_length = 0;
+    if (count == 0) return;
+    unsigned int size = 1;
+    while (size < 2*(unsigned int) count) size *= 2;
+    int* slots = 0;
+    while (true) {
+        slots = realloc(slots, size*sizeof(int));
+        bool found = false;
+        for (set->seed = 1; set->seed < 10000 && !found; ++set->seed) {
+            for (unsigned int h = 0; h < size; ++h) slots[h] = -1;
+            found = true;
+            for (int i = 0; i < count && found; ++i) {
+                unsigned int h = keyword_hash_word(words[i], set->seed) & (size - 1);
+                if (slots[h] >= 0 && strcmp(words[slots[h]], words[i]) != 0) found = false;
+                slots[h] = i;
+            }
+        }
+        if (found) break;
+        size *= 2;
+    }
+    set->seed--;
+    set->mask = size - 1;
+    set->table = calloc(size, sizeof(Keyword));
+    for (unsigned int h = 0; h < size; ++h) {
+        if (slots[h] < 0) continue;
+        int length = strlen(words[slots[h]]);
+        set->table[h] = (Keyword) {words[slots[h]], length};
+        if (length > set->max_length) set->max_length = length;
+    }
+    free(slots);
+}
+
+// Gives every character below 256 its column of actions, one per state,
+// and folds characters with the same column and delimiter flag into a
+// class. Then fills in the runs from the columns.
+void lang_build_table(Language* lang, const char* ident_start, const char* ident,
+                      const char* number_start, const char* number) {
+    unsigned char column[LX_STATES];
+    lang->class_count = 0;
+    for (int c = 0; c <= 256; ++c) {
+        // NUL comes first so it gets class 0, and 256 stands in for the
+        // letters past it.
+        bool ascii = c > 0 && c < 128;
+        bool letter = c >= 128 && lang_letter(c);
+        column[LX_CODE] = (ascii && strchr(ident_start, c)) || letter ? LX_START_IDENT :
+                          ascii && strchr(number_start, c) ? LX_START_NUMBER : LX_OTHER;
+        column[LX_IDENT] = (ascii && strchr(ident, c)) || letter ? LX_STAY : LX_END;
+        column[LX_NUMBER] = ascii && strchr(number, c) ? LX_STAY : LX_END;
+        column[LX_COMMENT] = ascii && c == lang->block_end[0] ? LX_CHECK : LX_STAY;
+        for (int k = 0; k < LANG_STRINGS; ++k) {
+            column[LX_STRING + k] = ascii && c == lang->escape ? LX_ESCAPE :
+                                    ascii && c == lang->strings[k] ? LX_CLOSE : LX_STAY;
+        }
+        bool delimiter = ascii && (c == lang->line_comment[0] || c == lang->block_start[0] ||
+                                   strchr(lang->strings, c) || c == lang->preprocessor ||
+                                   c == lang->preprocessor_string[0]);
+
+        int cls = 0;
+        while (cls < lang->class_count) {
+            bool same = lang->delimiter[cls] == delimiter;
+            for (int s = 0; s < LX_STATES && same; ++s) same = lang->table[s][cls] == column[s];
+            if (same) break;
+            cls++;
+        }
+        if (cls == lang->class_count) {
+            for (int s = 0; s < LX_STATES; ++s) lang->table[s][cls] = column[s];
+            lang->delimiter[cls] = delimiter;
+            lang->class_count++;
+        }
+        if (c < 256) lang->classes[c] = cls;
+        else lang->letter_class = cls;
+    }
+
+    for (int cls = 0; cls < lang->class_count; ++cls) {
+        lang->stays[LX_CODE][cls] = lang->table[LX_CODE][cls] == LX_OTHER && !lang->delimiter[cls];
+        for (int state = 1; state < LX_STATES; ++state) lang->stays[state][cls] = lang->table[state][cls] == LX_STAY;
+    }
+    memset(lang->runs, 0, sizeof(lang->runs));
+    for (int state = 0; state < LX_STATES; ++state) {
+        LangRun* run = &lang->runs[state];
+        for (int h = 0; h < 8; ++h) run->high[h] = 1 << h;
+        for (int c = 1; c < 128; ++c) {
+            if (lang->stays[state][lang->classes[c]]) run->low[c & 15] |= 1 << (c >> 4);
+        }
+    }
+}
+
+// Index of the first character from J on that isn't in RUN, or of the
+// first of the last few that don't fill a vector. The codepoints are
+// saturated down to bytes, so anything past ASCII ends up out of the set
+// and is left to the caller.
+#ifdef TEXT_SIMD
+__attribute__((target("ssse3")))
+int lang_run_ssse3(const LangRun* run, const int* content, int j, int length) {
+    const __m128i low = _mm_loadu_si128((const __m128i*) run->low);
+    const __m128i high = _mm_loadu_si128((const __m128i*) run->high);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; j + 16 <= length; j += 16) {
+        const __m128i* p = (const __m128i*) (content + j);
+        __m128i a = _mm_packs_epi32(_mm_loadu_si128(p), _mm_loadu_si128(p + 1));
+        __m128i b = _mm_packs_epi32(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3));
+        __m128i v = _mm_packus_epi16(a, b);
+        __m128i l = _mm_shuffle_epi8(low, _mm_and_si128(v, nibble));
+        __m128i h = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        unsigned int out = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128()));
+        if (out) return j + __builtin_ctz(out);
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+int lang_run_avx2(const LangRun* run, const int* content, int j, int length) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) run->low));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) run->high));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    // Packing works within each 128 bit half, this puts the bytes back in
+    // order four at a time.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; j + 32 <= length; j += 32) {
+        const __m256i* p = (const __m256i*) (content + j);
+        __m256i a = _mm256_packs_epi32(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+        __m256i b = _mm256_packs_epi32(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3));
+        __m256i v = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+        __m256i l = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+        __m256i h = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        unsigned int out = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256()));
+        if (out) return j + __builtin_ctz(out);
+    }
+    return j;
+}
+#endif
+
+// Index of the first character from J on that doesn't keep a token in
+// STATE going, LENGTH if they all do. Most tokens are short, so the first
+// few characters are looked up one at a time before the vector versions
+// take over. Past ASCII it's one at a time again.
+int lang_run(const Language* lang, int state, const int* content, int j, int length) {
+    const bool* stays = lang->stays[state];
+    int first = length - j > LANG_SCALAR ? j + LANG_SCALAR : length;
+    for (; j < first; ++j) {
+        if (!stays[LANGUAGE_CLASS(lang, content[j])]) return j;
+    }
+    while (j < length) {
+#ifdef TEXT_SIMD
+        if (lang_avx2 && length - j >= 32) {
+            j = lang_run_avx2(&lang->runs[state], content, j, length);
+            if (j == length) break;
+        } else if (lang_ssse3 && length - j >= 16) {
+            j = lang_run_ssse3(&lang->runs[state], content, j, length);
+            if (j == length) break;
+        }
+#endif
+        if (!stays[LANGUAGE_CLASS(lang, content[j])]) break;
+        j++;
+    }
+    return j;
+}
+
+// Copies the single word of a delimiter value into OUT, false if too long.
+bool lang_delimiter(char* out, size_t size, char* word) {
+    if (word == 0 || strlen(word) >= size) return false;
+    strcpy(out, word);
+    return true;
+}
+
+void lang_free(Language* lang) {
+    for (size_t i = 0; i < da_length(lang->extensions); ++i) free(lang->extensions[i]);
+    for (size_t i = 0; i < da_length(lang->words); ++i) free(lang->words[i]);
+    da_free(lang->extensions);
+    da_free(lang->words);
+    free(lang->keywords.table);
+}
+
+// Reads a definition, a KEY and its values on every line, and compiles it.
+// Returns false if it doesn't say which files it is for.
+bool lang_compile(Language* lang, char* source) {
+    memset(lang, 0, sizeof(Language));
+    lang->extensions = da_new(char*);
+    lang->words = da_new(char*);
+    char ident_start[128] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    char ident[128] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    char number_start[128] = "0123456789";
+    char number[128] = "0123456789";
+    bool ok = true;
+
+    char** words = da_new(char*);
+    char* line = source;
+    while (*line) {
+        char* end = strchr(line, '\n');
+        if (end == 0) end = line + strlen(line);
+        char* next = *end ? end + 1 : end;
+        *end = '\0';
+        _da_set(words, DA_LENGTH, 0);
+        char* p = line;
+        while (true) {
+            while (isspace((unsigned char) *p)) p++;
+            if (*p == '\0') break;
+            da_push(words, p);
+            while (*p && !isspace((unsigned char) *p)) p++;
+            if (*p) *p++ = '\0';
+        }
+        int count = da_length(words);
+        line = next;
+        if (count == 0) continue;
+
+        char* key = words[0];
+        char* value = count > 1 ? words[1] : 0;
+        if (strcmp(key, "NAME") == 0) ok &= lang_delimiter(lang->name, sizeof(lang->name), value);
+        else if (strcmp(key, "EXTENSIONS") == 0) {
+            for (int i = 1; i < count; ++i) da_push(lang->extensions, strdup(words[i]));
+        } else if (strcmp(key, "KEYWORDS") == 0) {
+            for (int i = 1; i < count; ++i) {
+                if (strlen(words[i]) < LANG_WORD) da_push(lang->words, strdup(words[i]));
+                else ok = false;
+            }
+        } else if (strcmp(key, "LINE_COMMENT") == 0) {
+            ok &= lang_delimiter(lang->line_comment, LANG_DELIM, value);
+        } else if (strcmp(key, "BLOCK_COMMENT") == 0) {
+            ok &= lang_delimiter(lang->block_start, LANG_DELIM, value);
+            ok &= lang_delimiter(lang->block_end, LANG_DELIM, count > 2 ? words[2] : 0);
+        } else if (strcmp(key, "STRING") == 0) {
+            for (int i = 1; i < count; ++i) {
+                size_t n = strlen(lang->strings);
+                if (strlen(words[i]) == 1 && n < LANG_STRINGS) lang->strings[n] = words[i][0];
+                else ok = false;
+            }
+        } else if (strcmp(key, "ESCAPE") == 0) {
+            if (value && strlen(value) == 1) lang->escape = value[0];
+            else ok = false;
+        } else if (strcmp(key, "PREPROCESSOR") == 0) {
+            if (value && strlen(value) == 1) lang->preprocessor = value[0];
+            else ok = false;
+        } else if (strcmp(key, "PREPROCESSOR_STRING") == 0) {
+            if (count == 3 && strlen(words[1]) == 1 && strlen(words[2]) == 1) {
+                lang->preprocessor_string[0] = words[1][0];
+                lang->preprocessor_string[1] = words[2][0];
+            } else ok = false;
+        } else if (strcmp(key, "IDENT_START") == 0) ok &= lang_delimiter(ident_start, 128, value);
+        else if (strcmp(key, "IDENT") == 0) ok &= lang_delimiter(ident, 128, value);
+        else if (strcmp(key, "NUMBER_START") == 0) ok &= lang_delimiter(number_start, 128, value);
+        else if (strcmp(key, "NUMBER") == 0) ok &= lang_delimiter(number, 128, value);
+        else ok = false;
+    }
+    da_free(words);
+    if (!ok) error = "Bad line in a language definition";
+
+    if (da_length(lang->extensions) == 0) {
+        lang_free(lang);
+        return false;
+    }
+    keyword_build(&lang->keywords, lang->words);
+    lang_build_table(lang, ident_start, ident, number_start, number);
+    return true;
+}
+
+// Loads every .lang file in the config directory. When there are none the
+// default ones are written there first.
+void load_languages() {
+#ifdef TEXT_SIMD
+    __builtin_cpu_init();
+    lang_avx2 = __builtin_cpu_supports("avx2");
+    lang_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+    languages = da_new(Language);
+    char dir[sizeof(config_path)];
+    memcpy(dir, config_path, sizeof(config_path));
+    char* dname = dirname(dir);
+    char path[sizeof(config_path) + 32];
+
+    FilePathList files = LoadDirectoryFilesEx(dname, ".lang", false);
+    if (files.count == 0) {
+        size_t defaults = sizeof(default_languages)/sizeof(*default_languages);
+        for (size_t i = 0; i < defaults; ++i) {
+            snprintf(path, sizeof(path), "%s/%s", dname, default_languages[i][0]);
+            FILE* f = fopen(path, "w");
+            if (f != NULL) {
+                fwrite(default_languages[i][1], 1, strlen(default_languages[i][1]), f);
+                fclose(f);
+            }
+            char* source = strdup(default_languages[i][1]);
+            Language lang;
+            if (lang_compile(&lang, source)) da_push(languages, lang);
+            free(source);
+        }
+    }
+    for (unsigned int i = 0; i < files.count; ++i) {
+        char* source = LoadFileText(files.paths[i]);
+        if (source == NULL) continue;
+        Language lang;
+        if (lang_compile(&lang, source)) da_push(languages, lang);
+        UnloadFileText(source);
+    }
+    UnloadDirectoryFiles(files);
+}
+
+// Index of the language for file name NAME, -1 if none has its extension.
+int lang_find(const char* name) {
+    size_t length = strlen(name);
+    for (size_t i = 0; i < da_length(languages); ++i) {
+        char** extensions = languages[i].extensions;
+        for (size_t e = 0; e < da_length(extensions); ++e) {
+            size_t n = strlen(extensions[e]);
+            if (n <= length && strcmp(name + length - n, extensions[e]) == 0) return i;
+        }
+    }
+    return -1;
+}
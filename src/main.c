@@ -9,26 +9,40 @@
 #include "icon.c"
 #define DA_IMPL
 #include "da.h"
+#include "text.c"
 
 char* error;
 #include "config.c"
+#include "language.c"
+#include "glyphs.c"
 #include "buffer.c"
 
-void draw_text(int* str, Font font, size_t x, size_t y,
-               size_t font_size, int posx, size_t line_num, Token* tokens) {
-    size_t dx = 0;
-
-    for (size_t i = 0; i < da_length(tokens); ++i) {
-        Token token = tokens[i];
-        size_t token_length = token.end - token.start;
-        if (token.line == line_num && token_length > 0) {
-            int dstr[token_length];
-            memcpy(dstr, str + token.start, token_length*sizeof(int));
-            char* utf8_string = LoadUTF8(dstr, token_length);
-            DrawTextEx(font, utf8_string, (Vector2) {(float) dx+x+posx, (float) y}, font_size, 0, token.color);
-            Vector2 text_size = MeasureTextEx(font, utf8_string, font_size, 0);
-            UnloadUTF8(utf8_string);
-            dx += text_size.x;
+// Draws LINE glyph by glyph from the codepoints in the text, colored by
+// the tokens covering them, and stops at the right edge of the window.
+void draw_text(Buffer* buf, Line line, Glyphs* glyphs, size_t x, size_t y,
+               int posx, size_t line_num) {
+    size_t count = 0;
+    Token* tokens = buf_line_tokens(buf, line_num, &count);
+    if (buf->language == LANGUAGE_NONE) count = 0;
+    float dx = (float) x + posx;
+    float right = GetScreenWidth();
+    size_t col = 0, t = 0;
+
+    TextIter it;
+    char* span;
+    size_t n;
+    text_iter_init(&buf->text, &it, line.start, line.end);
+    while (text_iter_next(&it, &span, &n, 0)) {
+        for (size_t i = 0; i < n; ++col) {
+            int size;
+            int c = text_utf8_decode(span + i, n - i, &size);
+            i += size;
+            // Tokens of a line come in order, so walk them forward.
+            while (t < count && (size_t) tokens[t].start + tokens[t].length <= col) t++;
+            Color color = t < count && tokens[t].start <= col ? *PALETTE[tokens[t].class] : DEFAULT;
+            if (c != ' ' && c != '\t') glyph_draw(glyphs, c, (Vector2) {dx, (float) y}, color);
+            dx += glyph_advance(glyphs, c);
+            if (dx > right) return;
         }
     }
 }
@@ -37,27 +51,30 @@ void print_tokens(Token* tokens) {
     printf("len(tokens) = %zu\n", da_length(tokens));
     printf("tokens = {\n");
     for (size_t i = 0; i < da_length(tokens); ++i) {
-        printf("  [%zu] = (Token) {.start = %zu, .end = %zu, .line = %zu, .color = (Color) {%d %d %d %d}}\n",
-                i, tokens[i].start, tokens[i].end, tokens[i].line, tokens[i].color.r, tokens[i].color.g, tokens[i].color.b, tokens[i].color.a);
+        printf("  [%zu] = (Token) {.start = %u, .length = %u, .class = %u}\n",
+                i, tokens[i].start, tokens[i].length, tokens[i].class);
     }
     printf("}\n");
 }
 
-void print_lines(Line* lines) {
-    printf("len(lines) = %zu\n", da_length(lines));
+void print_lines(Buffer* buf) {
+    printf("len(lines) = %zu\n", buf_line_count(buf));
     printf("lines = {\n");
-    for (size_t i = 0; i < da_length(lines); ++i) {
+    for (size_t i = 0; i < buf_line_count(buf); ++i) {
+        Line line = buf_line(buf, i);
         printf("  [%zu] = (Line) {.start = %zu, .end = %zu}\n",
-                i, lines[i].start, lines[i].end);
+                i, line.start, line.end);
     }
     printf("}\n");
 }
 
-void print_content(int* content) {
-    char* ucontent = LoadUTF8(content, da_length(content));
-    for (size_t i = 0; i < strlen(ucontent); ++i) putc(ucontent[i], stdout);
+void print_content(Text* text) {
+    TextIter it;
+    char* span;
+    size_t n;
+    text_iter_init(text, &it, 0, text_length(text));
+    while (text_iter_next(&it, &span, &n, 0)) fwrite(span, 1, n, stdout);
     putc('\n', stdout);
-    UnloadUTF8(ucontent);
 }
 
 float lerp(float a, float b, float t) {
@@ -81,166 +98,49 @@ Color* lerp_color(Color c1, Color c2, float t) {
 #define ERROR_FADE (1*60)
 size_t error_time = 0;
 
-void draw_buffer(Buffer* buf, Font font, int font_size, int posy, int posx, int line_size, int pad, bool select_line, int inner_pad) {
-    int y = pad - posy * font_size - posy * inner_pad;
+void draw_buffer(Buffer* buf, Glyphs* glyphs, int font_size, int posy, int posx, int line_size, int pad, bool select_line, int inner_pad) {
+    // Line POSY is drawn at PAD, so the first one that shows is the one the
+    // top of the window cuts through.
+    int line_height = font_size + inner_pad;
+    int first = posy - (font_size + pad)/line_height;
+    if (first < 0) first = 0;
+    int y = pad + (first - posy)*line_height;
+    color_highlight_update(buf, first, posy + GetScreenHeight()/line_height + 1);
     size_t cl, cc, sl, sc;
     bool selection = buf_get_selection_cursor(buf, &sl, &sc);
     buf_get_cursor(buf, &cl, &cc);
-    for (size_t i = 0; i < da_length(buf->lines); ++i) {
-        if (y < -font_size) {
-            y += font_size + inner_pad;
-            continue;
-        }
-        Line line = buf->lines[i];
+    for (size_t i = first; i < buf_line_count(buf); ++i) {
+        Line line = buf_line(buf, i);
         
         const char* lstr = TextFormat("%d ", i + 1);
-        Vector2 lsize = MeasureTextEx(font, lstr, font_size, 0);
-        DrawTextEx(font, lstr, (Vector2) {pad + posx - lsize.x + line_size, y}, font_size, 0, MIDDLEGROUND);
+        float lwidth = glyphs_measure_utf8(glyphs, lstr, strlen(lstr));
+        glyphs_draw_utf8(glyphs, lstr, (Vector2) {pad + posx - lwidth + line_size, y}, MIDDLEGROUND);
 
         if (cl == i && select_line && buf->is_searching == 0) {
-            int str[line.end-line.start];
-            memcpy(str, buf->content + line.start, (line.end-line.start)*sizeof(int));
-            char* utf8_string = LoadUTF8(str, line.end - line.start);
-            Vector2 size = {0};
-            if (line.end-line.start == 0) size = (Vector2) {.x = 0, .y = font_size};
-            else size = MeasureTextEx(font, utf8_string, font_size, 0);
-            UnloadUTF8(utf8_string);
-            DrawRectangle(pad + line_size + posx, y, size.x, size.y, FAINT_FG);
+            float width = buf_measure(buf, glyphs, line.start, line.end);
+            DrawRectangle(pad + line_size + posx, y, width, font_size, FAINT_FG);
         }
 
-        if (selection && buf->selection_origin > (int) buf->cursor && buf->is_searching == 0) {
-            if (cl == i && cl == sl) {
-                int str[sc-cc], strl = sc-cc;
-                memcpy(str, buf->content + buf->cursor, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (sc-cc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                int sstr[cc], sstrl = cc;
-                memcpy(sstr, buf->content + line.start, sstrl*sizeof(int));
-                utf8_string = LoadUTF8(sstr, sstrl);
-                Vector2 ssize = {0};
-                if (cc == 0) ssize = (Vector2) {.x = 0, .y = font_size};
-                else ssize = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-
-                DrawRectangle(pad + line_size + posx + ssize.x, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (cl == i && cl != sl) {
-                int str[cc], strl = cc;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (cc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                int sstr[(line.end-line.start)-cc], sstrl = (line.end-line.start)-cc;
-                memcpy(sstr, buf->content + line.start + cc, sstrl*sizeof(int));
-                utf8_string = LoadUTF8(sstr, sstrl);
-                Vector2 ssize = {0};
-                if (line.end-line.start-cc == 0) ssize = (Vector2) {.x = 0, .y = font_size};
-                else ssize = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-
-                DrawRectangle(pad + line_size + posx + size.x, y, ssize.x, ssize.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (sl == i && cl != sl) {
-                int str[sc], strl = sc;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (sc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                DrawRectangle(pad + line_size + posx, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (cl < i && sl > i) {
-                int str[line.end-line.start], strl = line.end-line.start;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (line.end-line.start == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                DrawRectangle(pad + line_size + posx, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            }
-        } else if (selection && buf->selection_origin < (int) buf->cursor && buf->is_searching == 0) {
-            if (cl == i && cl == sl) {
-                int str[cc-sc], strl = cc-sc;
-                memcpy(str, buf->content + buf->selection_origin, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (cc-sc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                int sstr[sc], sstrl = sc;
-                memcpy(sstr, buf->content + line.start, sstrl*sizeof(int));
-                utf8_string = LoadUTF8(sstr, sstrl);
-                Vector2 ssize = {0};
-                if (sc == 0) ssize = (Vector2) {.x = 0, .y = font_size};
-                else ssize = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-
-                DrawRectangle(pad + line_size + posx + ssize.x, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (cl == i && cl != sl) {
-                int str[cc], strl = cc;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (cc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                DrawRectangle(pad + line_size + posx, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (sl == i && cl != sl) {
-                int str[(line.end-line.start)-sc], strl = (line.end-line.start)-sc;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (line.end-line.start-sc == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                int sstr[sc], sstrl = sc;
-                memcpy(sstr, buf->content + line.start, sstrl*sizeof(int));
-                utf8_string = LoadUTF8(sstr, sstrl);
-                Vector2 ssize = {0};
-                if (sc == 0) ssize = (Vector2) {.x = 0, .y = font_size};
-                else ssize = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                DrawRectangle(pad + line_size + posx + ssize.x, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
-            } else if (cl > i && sl < i) {
-                int str[line.end-line.start], strl = line.end-line.start;
-                memcpy(str, buf->content + line.start, strl*sizeof(int));
-                char* utf8_string = LoadUTF8(str, strl);
-                Vector2 size = {0};
-                if (line.end-line.start == 0) size = (Vector2) {.x = 0, .y = font_size};
-                else size = MeasureTextEx(font, utf8_string, font_size, 0);
-                UnloadUTF8(utf8_string);
-                
-                DrawRectangle(pad + line_size + posx, y, size.x, size.y, select_line?MIDDLEGROUND:FAINT_FG);
+        size_t start, end;
+        if (buf_get_selection(buf, &start, &end) && start != end && buf->is_searching == 0) {
+            if (line.start <= end && start <= line.end) {
+                if (start < line.start) start = line.start;
+                if (end > line.end) end = line.end;
+                float x = buf_measure(buf, glyphs, line.start, start);
+                float width = buf_measure(buf, glyphs, start, end);
+                DrawRectangle(pad + line_size + posx + x, y, width, font_size, select_line?MIDDLEGROUND:FAINT_FG);
             }
         }
 
-        draw_text(buf->content + line.start,
-                  font, pad+line_size, y, font_size, posx, i, buf->tokens);
-
-        if (cl == i && (!selection || buf->cursor == (size_t) buf->selection_origin) && buf->is_searching == 0) {
-            int str[cc];
-            memcpy(str, buf->content + line.start, cc*sizeof(int));
-            char* utf8_string = LoadUTF8(str, cc);
-            size_t size = 0;
-            if (cc == 0) size = 0;
-            else size = MeasureTextEx(font, utf8_string, font_size, 0).x;
-            UnloadUTF8(utf8_string);
-            DrawRectangle(size + pad + line_size + posx, y, 2, font_size, FOREGROUND);
+        draw_text(buf, line, glyphs, pad+line_size, y, posx, i);
+
+        if (cl == i && (!selection || buf->cursor == buf->selection_origin) && buf->is_searching == 0) {
+            size_t lp, x;
+            buf_get_cursor_pos(buf, glyphs, &lp, &x);
+            DrawRectangle(x + pad + line_size + posx, y, 2, font_size, FOREGROUND);
         }
     
-        y += font_size + inner_pad;
+        y += line_height;
         if (y > GetScreenHeight()) break;
     }
 
@@ -252,15 +152,15 @@ void draw_buffer(Buffer* buf, Font font, int font_size, int posy, int posx, int
         else alpha = 1.0f;
 
         long p = 8;
-        Vector2 error_size = MeasureTextEx(font, error, font_size, 0);
+        float error_width = glyphs_measure_utf8(glyphs, error, strlen(error));
         Rectangle rec = {
-            .x = GetScreenWidth()-error_size.x-p*3,
+            .x = GetScreenWidth()-error_width-p*3,
             .y = p,
-            .width = error_size.x + p*2,
-            .height = error_size.y + p*2,
+            .width = error_width + p*2,
+            .height = font_size + p*2,
         };
         DrawRectangleRounded(rec, 0.6, 5, FAINT_FG_A(alpha*255));
-        DrawTextEx(font, error, (Vector2) {rec.x+p, rec.y+p}, font_size, 0, FOREGROUND_A(alpha*255));
+        glyphs_draw_utf8(glyphs, error, (Vector2) {rec.x+p, rec.y+p}, FOREGROUND_A(alpha*255));
 
         error_time--;
     }
@@ -297,6 +197,7 @@ bool key_pressed(int key) {
 #define SEARCHING_GOTO 2
 
 void update_buf(Buffer* buf, bool change_lines, bool read_only) {
+    int* typed = da_new(int);
     int key_char = GetCharPressed();
     while (key_char != 0 && !read_only) {
         if (change_lines) {
@@ -308,13 +209,17 @@ void update_buf(Buffer* buf, bool change_lines, bool read_only) {
         if (buf->is_searching != 0) {
             da_push(buf->search_buffer, key_char);
         } else {
-            if (buf->selection_origin != -1) remove_selection(buf);
-            push_at_cursor(buf, key_char);
-            buf->changed = true;
-            if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+            da_push(typed, key_char);
         }
         key_char = GetCharPressed();
     }
+    if (da_length(typed) > 0) {
+        if (buf->has_selection) remove_selection(buf);
+        insert_range(buf, buf->cursor, typed, da_length(typed));
+        buf->changed = true;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
+    }
+    da_free(typed);
 
     if (buf->is_searching != SEARCHING_NONE) {
         if (key_pressed(KEY_BACKSPACE) && da_length(buf->search_buffer) > 0) {
@@ -332,21 +237,19 @@ void update_buf(Buffer* buf, bool change_lines, bool read_only) {
                 size_t line = strtoull(ustr, &strp, 0);
                 if (*strp == '\0') {
                     if (line <= 0) line = 1;
-                    else if (line > da_length(buf->lines)) line = da_length(buf->lines);
-                    buf->cursor = buf->lines[line-1].start;
-                    buf->selection_origin = -1;
+                    else if (line > buf_line_count(buf)) line = buf_line_count(buf);
+                    buf->cursor = text_line_start(&buf->text, line-1);
+                    buf->has_selection = false;
                 }
                 buf->is_searching = SEARCHING_NONE;
                 da_free(buf->search_buffer);
                 buf->search_buffer = da_new(int);
                 UnloadUTF8(ustr);
             } else if (buf->is_searching == SEARCHING_SEARCH) {
-                for (size_t i = buf->cursor; i < da_length(buf->content) - da_length(buf->search_buffer); ++i) {
-                    if (memcmp(buf->content + i, buf->search_buffer, da_length(buf->search_buffer)*sizeof(int)) == 0) {
-                        buf->cursor = i;
-                        buf->selection_origin = i + da_length(buf->search_buffer);
-                        break;
-                    }
+                size_t i;
+                if (text_find(&buf->text, buf->cursor, buf->search_buffer, da_length(buf->search_buffer), &i)) {
+                    buf->cursor = i;
+                    buf_select(buf, i + da_length(buf->search_buffer));
                 }
                 buf->is_searching = SEARCHING_NONE;
                 da_free(buf->search_buffer);
@@ -364,15 +267,16 @@ void update_buf(Buffer* buf, bool change_lines, bool read_only) {
 
     if (IsKeyDown(KEY_LEFT_CONTROL) && key_pressed(KEY_A)) {
         buf->cursor = 0;
-        buf->selection_origin = buf->lines[da_length(buf->lines)-1].end;
+        buf_select(buf, text_length(&buf->text));
         return;
     }
 
     if (IsKeyDown(KEY_LEFT_CONTROL) && key_pressed(KEY_Q)) {
         size_t cursor_line, cursor_char;
         buf_get_cursor(buf, &cursor_line, &cursor_char);
-        buf->cursor = buf->lines[cursor_line].end;
-        buf->selection_origin = buf->lines[cursor_line].start;
+        Line line = buf_line(buf, cursor_line);
+        buf->cursor = line.end;
+        buf_select(buf, line.start);
         return;
     }
 
@@ -382,94 +286,86 @@ void update_buf(Buffer* buf, bool change_lines, bool read_only) {
     }
 
     if (IsKeyDown(KEY_LEFT_SHIFT)) {
-        if (buf->selection_origin == -1) buf->selection_origin = buf->cursor;
+        if (!buf->has_selection) buf_select(buf, buf->cursor);
     }
 
     if (key_pressed(KEY_ENTER) && !change_lines && !read_only) {
-        if (buf->selection_origin != -1) remove_selection(buf);
+        if (buf->has_selection) remove_selection(buf);
         size_t l, c;
         buf_get_cursor(buf, &l, &c);
-        Line line = buf->lines[l];
+        Line line = buf_line(buf, l);
         size_t spaces = 0;
         for (size_t i = line.start; i < line.end; ++i) {
-            if (buf->content[i] == ' ') spaces++;
+            if (text_get(&buf->text, i) == ' ') spaces++;
             else break;
         }
-        push_at_cursor(buf, '\n');
-        for (size_t i = 0; i < spaces; ++i) push_at_cursor(buf, ' ');
+        int* indent = malloc((spaces + 1)*sizeof(int));
+        indent[0] = '\n';
+        for (size_t i = 1; i <= spaces; ++i) indent[i] = ' ';
+        insert_range(buf, buf->cursor, indent, spaces + 1);
+        free(indent);
         buf->changed = true;
     } else if (key_pressed(KEY_DELETE) && !read_only) {
-        if (buf->selection_origin != -1) remove_selection(buf);
-        else if (buf->cursor < da_length(buf->content) && (change_lines ? buf->content[buf->cursor] != '\n' : true)) {
-            int temp[da_length(buf->content) - buf->cursor - 1];
-            memcpy(temp, buf->content + buf->cursor + 1, (da_length(buf->content) - buf->cursor - 1)*sizeof(int));
-            memcpy(buf->content + buf->cursor, temp, (da_length(buf->content) - buf->cursor - 1)*sizeof(int));
-            da_pop(buf->content, 0);
+        if (buf->has_selection) remove_selection(buf);
+        else if (buf->cursor < text_length(&buf->text) && (change_lines ? text_get(&buf->text, buf->cursor) != '\n' : true)) {
+            delete_range(buf, buf->cursor, buf->cursor + 1);
             buf->changed = true;
-            if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+            if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
         }
     } else if (key_pressed(KEY_BACKSPACE) && !read_only) {
-        if (buf->selection_origin != -1) remove_selection(buf);
-        else if (buf->cursor > 0 && (change_lines ? buf->content[buf->cursor-1] != '\n' : true)) {
-            int temp[da_length(buf->content) - buf->cursor];
-            memcpy(temp, buf->content + buf->cursor, sizeof(int)*(da_length(buf->content) - buf->cursor));
-            memcpy(buf->content + buf->cursor - 1, temp, sizeof(int)*(da_length(buf->content) - buf->cursor));
-            da_pop(buf->content, 0);
-            buf->cursor -= 1;
+        if (buf->has_selection) remove_selection(buf);
+        else if (buf->cursor > 0 && (change_lines ? text_get(&buf->text, buf->cursor-1) != '\n' : true)) {
+            delete_range(buf, buf->cursor - 1, buf->cursor);
             buf->changed = true;
-            if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+            if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
         }
     } else if (key_pressed(KEY_TAB) && !read_only) {
-        if (buf->selection_origin != -1) remove_selection(buf);
-        push_at_cursor(buf, ' ');
-        push_at_cursor(buf, ' ');
-        push_at_cursor(buf, ' ');
-        push_at_cursor(buf, ' ');
+        if (buf->has_selection) remove_selection(buf);
+        int spaces[] = {' ', ' ', ' ', ' '};
+        insert_range(buf, buf->cursor, spaces, 4);
         buf->changed = true;
-        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
     } else if (key_pressed(KEY_LEFT)) {
         if (buf->cursor > 0) {
             buf->cursor -= 1;
         }
-        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
     } else if (key_pressed(KEY_RIGHT)) {
-        if (buf->cursor < da_length(buf->content)) {
+        if (buf->cursor < text_length(&buf->text)) {
             buf->cursor += 1;
         }
-        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
     } else if (key_pressed(KEY_UP)) {
         size_t l, c;
         buf_get_cursor(buf, &l, &c);
         if (l > 0) {
-            Line next_line = buf->lines[l - 1];
+            Line next_line = buf_line(buf, l - 1);
             if (next_line.end - next_line.start < c) {
                 buf->cursor = next_line.end;
             } else {
                 buf->cursor = next_line.start + c;
             }
         }
-        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
     } else if (key_pressed(KEY_DOWN)) {
         size_t l, c;
         buf_get_cursor(buf, &l, &c);
-        if (l < da_length(buf->lines)-1) {
-            Line next_line = buf->lines[l + 1];
+        if (l < buf_line_count(buf)-1) {
+            Line next_line = buf_line(buf, l + 1);
             if (next_line.end - next_line.start < c) {
                 buf->cursor = next_line.end;
             } else {
                 buf->cursor = next_line.start + c;
             }
         }
-        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->selection_origin = -1;
+        if (IsKeyUp(KEY_LEFT_SHIFT)) buf->has_selection = false;
     }
 
     if (change_lines) buf->changed = false;
 
-    update_newlines(buf);
-    color_highlight(buf);
 }
 
-void draw_statusbar(Buffer* buf, Font font, size_t font_size) {
+void draw_statusbar(Buffer* buf, Glyphs* glyphs, size_t font_size) {
     int pad = 8;
 
     size_t l, c;
@@ -486,25 +382,26 @@ void draw_statusbar(Buffer* buf, Font font, size_t font_size) {
     }
 
     const char* lstatus;
-    if (buf->is_searching == SEARCHING_NONE) lstatus = TextFormat("%s%s", buf->filename == 0 ? "<new file>" : basename(str), buf->changed ? "*" : "");
+    if (buf->is_searching == SEARCHING_NONE) lstatus = TextFormat("%s%s%s", buf->filename == 0 ? "<new file>" : basename(str), buf->changed ? "*" : "", buf->readonly ? " [read-only]" : "");
     else if (buf->is_searching == SEARCHING_GOTO) {
         char* ustr = LoadUTF8(buf->search_buffer, da_length(buf->search_buffer));
         lstatus = TextFormat("line: %s", ustr);
         UnloadUTF8(ustr);
-    } else if (buf->is_searching == SEARCHING_SEARCH) {
+    } else {
         char* ustr = LoadUTF8(buf->search_buffer, da_length(buf->search_buffer));
         lstatus = TextFormat("find: %s", ustr);
         UnloadUTF8(ustr);
     }
-    Vector2 lssize = MeasureTextEx(font, lstatus, font_size, 0);
+    float lswidth = glyphs_measure_utf8(glyphs, lstatus, strlen(lstatus));
     if (buf->is_searching == SEARCHING_GOTO || buf->is_searching == SEARCHING_SEARCH) {
-        DrawRectangle(pad + lssize.x, wh-lssize.y-pad, 2, lssize.y, FOREGROUND);
+        DrawRectangle(pad + lswidth, wh-font_size-pad, 2, font_size, FOREGROUND);
     }
-    DrawTextEx(font, lstatus, (Vector2) {pad, wh - lssize.y - pad}, font_size, 0, FOREGROUND);
+    glyphs_draw_utf8(glyphs, lstatus, (Vector2) {pad, wh - font_size - pad}, FOREGROUND);
     
     const char* rstatus = TextFormat("%ld:%ld", l+1, c+1);
-    Vector2 rssize = MeasureTextEx(font, rstatus, font_size, 0);
-    DrawTextEx(font, rstatus, (Vector2) {ww - rssize.x - pad, wh - lssize.y - pad}, font_size, 0, FOREGROUND);
+    if (buf->loader) rstatus = TextFormat("loading %d%%  %s", (int) (buf_load_progress(buf)*100), rstatus);
+    float rswidth = glyphs_measure_utf8(glyphs, rstatus, strlen(rstatus));
+    glyphs_draw_utf8(glyphs, rstatus, (Vector2) {ww - rswidth - pad, wh - font_size - pad}, FOREGROUND);
 }
 
 #define STATE_TEXT 0
@@ -514,16 +411,42 @@ void draw_statusbar(Buffer* buf, Font font, size_t font_size) {
 
 int state = STATE_TEXT;
 
-Font load_font(size_t font_size) {
-    int codepoints[512] = { 0 };
-    for (int i = 0; i < 95; i++) codepoints[i] = 32 + i;
-    for (int i = 0; i < 255; i++) codepoints[96 + i] = 0x400 + i;
-    if (FileExists("font.ttf") && !DirectoryExists("font.ttf"))
-        return LoadFontEx("font.ttf", font_size, codepoints, 512);
-    else return LoadFontFromMemory(".ttf", __FONT_TTF, __FONT_TTF_LENGTH, font_size, codepoints, 512);
+// Glyphs of the last FONT_SIZES sizes zoomed to, so zooming back and forth
+// only switches between them. The least recently used size makes room for
+// a new one. The TTF is read once and kept, glyphs are rasterized from it
+// as needed.
+#define FONT_SIZES 4
+Glyphs font_sizes[FONT_SIZES];
+size_t font_used[FONT_SIZES];
+size_t font_tick = 0;
+
+Glyphs* load_font(int font_size) {
+    static const unsigned char* ttf = 0;
+    static int ttf_size = 0;
+    if (ttf == 0 && FileExists("font.ttf") && !DirectoryExists("font.ttf")) ttf = LoadFileData("font.ttf", &ttf_size);
+    if (ttf == 0) {
+        ttf = __FONT_TTF;
+        ttf_size = __FONT_TTF_LENGTH;
+    }
+    int slot = 0;
+    for (int i = 0; i < FONT_SIZES; ++i) {
+        if (font_sizes[i].size == font_size) {
+            font_used[i] = ++font_tick;
+            return &font_sizes[i];
+        }
+        if (font_used[i] < font_used[slot]) slot = i;
+    }
+    if (font_sizes[slot].size != 0) glyphs_unload(&font_sizes[slot]);
+    font_sizes[slot] = glyphs_init(ttf, ttf_size, font_size);
+    font_used[slot] = ++font_tick;
+    return &font_sizes[slot];
 }
 
 int main(int argc, char** argv) {
+    SetTraceLogLevel(LOG_NONE);
+    load_config();
+    text_select_kernel();
+    load_languages();
     Buffer buf = {0};
     if (argc == 2) {
         if (FileExists(argv[1]) && !DirectoryExists(argv[1])) {
@@ -543,17 +466,15 @@ int main(int argc, char** argv) {
     Buffer help_buffer = {0};
 
     bool debug = false;
-    load_config();
 
     SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-    SetTraceLogLevel(LOG_NONE);
     InitWindow(800, 600, "txt");
     SetExitKey(0);
     init_open_buffer(&open_buffer);
     init_save_buffer(&save_buffer);
     init_help_buffer(&help_buffer);
     int font_size = 24;
-    Font font = load_font(font_size);
+    Glyphs* glyphs = load_font(font_size);
 
     Image icon = LoadImageFromMemory(".png", _ICON_PNG, _ICON_PNG_LENGTH);
     SetWindowIcon(icon);
@@ -564,9 +485,12 @@ int main(int argc, char** argv) {
     while (!WindowShouldClose()) {
         size_t l, c;
         size_t lp, cp;
-        Buffer cursorbuf = state == STATE_TEXT ? buf : state == STATE_OPEN ? open_buffer : state == STATE_SAVE ? save_buffer : help_buffer;
-        buf_get_cursor(&cursorbuf, &l, &c);
-        buf_get_cursor_pos(&cursorbuf, font, font_size, &lp, &cp);
+        size_t start, end;
+        buf_load_poll(&buf);
+        buf_index(&buf);
+        Buffer* cursorbuf = state == STATE_TEXT ? &buf : state == STATE_OPEN ? &open_buffer : state == STATE_SAVE ? &save_buffer : &help_buffer;
+        buf_get_cursor(cursorbuf, &l, &c);
+        buf_get_cursor_pos(cursorbuf, glyphs, &lp, &cp);
 
         Vector2 mouse_pos = GetMousePosition();
         if (mouse_pos.y >= GetScreenHeight() - font_size - pad*2) SetMouseCursor(MOUSE_CURSOR_DEFAULT);
@@ -577,77 +501,38 @@ int main(int argc, char** argv) {
             int tx = mouse_pos.x - lines_size - posx;
             if (tx > 0 && mouse_pos.y < GetScreenHeight() - font_size - pad*2) {
                 int ty = (mouse_pos.y + pos*(font_size+inner_pad) - pad) / (font_size+inner_pad);
-                if (ty < (int) da_length(buf.lines)) {
-                    Line line = buf.lines[ty];
-                    int str[line.end-line.start];
-                    memcpy(str, buf.content + line.start, sizeof(int)*(line.end-line.start));
-                    char* ustr = LoadUTF8(str, line.end-line.start);
-                    Vector2 str_size = MeasureTextEx(font, ustr, font_size, 0);
-                    UnloadUTF8(ustr);
-                    if (str_size.x < tx) buf.cursor = line.end;
-                    else {
-                        for (int i = line.end-line.start-1; i >= 0; --i) {
-                            ustr = LoadUTF8(str, i);
-                            str_size = MeasureTextEx(font, ustr, font_size, 0);
-                            UnloadUTF8(ustr);
-                            if (str_size.x < tx) { buf.cursor = i + line.start; break; }
-                        }
-                    }
+                if (ty < (int) buf_line_count(&buf)) {
+                    buf.cursor = buf_hit(&buf, glyphs, buf_line(&buf, ty), tx);
                 }
             }
         } else if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-            buf.selection_origin = buf.cursor;
+            buf_select(&buf, buf.cursor);
             int tx = mouse_pos.x - lines_size - posx;
             if (tx > 0 && mouse_pos.y < GetScreenHeight() - font_size - pad*2) {
                 int ty = (mouse_pos.y + pos*(font_size+inner_pad) - pad) / (font_size+inner_pad);
-                if (ty < (int) da_length(buf.lines)) {
-                    Line line = buf.lines[ty];
-                    int str[line.end-line.start];
-                    memcpy(str, buf.content + line.start, sizeof(int)*(line.end-line.start));
-                    char* ustr = LoadUTF8(str, line.end-line.start);
-                    Vector2 str_size = MeasureTextEx(font, ustr, font_size, 0);
-                    UnloadUTF8(ustr);
-                    if (str_size.x < tx) buf.selection_origin = line.end;
-                    else {
-                        for (int i = line.end-line.start-1; i >= 0; --i) {
-                            ustr = LoadUTF8(str, i);
-                            str_size = MeasureTextEx(font, ustr, font_size, 0);
-                            UnloadUTF8(ustr);
-                            if (str_size.x < tx) { buf.selection_origin = i + line.start; break; }
-                        }
-                    }
+                if (ty < (int) buf_line_count(&buf)) {
+                    buf_select(&buf, buf_hit(&buf, glyphs, buf_line(&buf, ty), tx));
                 }
             }
         }
         
         if (IsKeyDown(KEY_LEFT_CONTROL)) {
-            if (key_pressed(KEY_EQUAL) && font_size <= 64) {
+            float wheel = GetMouseWheelMove();
+            if ((key_pressed(KEY_EQUAL) || wheel > 0) && font_size <= 64) {
                 font_size += 2;
-                UnloadFont(font);
-                font = load_font(font_size);
-            } else if (key_pressed(KEY_MINUS) && font_size >= 16) {
+                glyphs = load_font(font_size);
+            } else if ((key_pressed(KEY_MINUS) || wheel < 0) && font_size >= 16) {
                 font_size -= 2;
-                UnloadFont(font);
-                font = load_font(font_size);
+                glyphs = load_font(font_size);
             } else if (key_pressed(KEY_D)) {
                 debug = !debug;
             } else if (key_pressed(KEY_L)) {
                 if (lines_size == 80) lines_size = 0;
                 else if (lines_size == 0) lines_size = 80;
-            } else if (key_pressed(KEY_C) && buf.selection_origin != -1) {
-                size_t start = buf.cursor;
-                size_t end = buf.selection_origin;
-                if (start > end) {
-                    start = buf.selection_origin;
-                    end = buf.cursor;
-                }
-                int clipboard[end-start];
-                memcpy(clipboard, buf.content + start, sizeof(int)*(end-start));
-                char* utf8string = LoadUTF8(clipboard, end-start);
-                SetClipboardText(utf8string);
-                UnloadUTF8(utf8string);
-                update_newlines(&buf);
-                color_highlight(&buf);
+            } else if (key_pressed(KEY_C) && buf_get_selection(&buf, &start, &end)) {
+                char* utf8string = buf_load_utf8(&buf, start, end);
+                if (utf8string) SetClipboardText(utf8string);
+                free(utf8string);
             }
         }
 
@@ -668,36 +553,28 @@ int main(int argc, char** argv) {
                         save_file(&buf);
                     }
                 } else if (key_pressed(KEY_V) && buf.readonly == false) {
-                    if (buf.selection_origin != -1) {
+                    if (buf.has_selection) {
                         remove_selection(&buf);
                     }
                     const char* clipboard = GetClipboardText();
                     int cliplen;
                     int* clipcodep = LoadCodepoints(clipboard, &cliplen);
+                    int length = 0;
                     for (int i = 0; i < cliplen; ++i) {
-                        if (clipcodep[i] == 0x0d) continue;
-                        push_at_cursor(&buf, clipcodep[i]);
+                        if (clipcodep[i] != 0x0d) clipcodep[length++] = clipcodep[i];
                     }
-                    update_newlines(&buf);
-                    color_highlight(&buf);
+                    insert_range(&buf, buf.cursor, clipcodep, length);
                     UnloadCodepoints(clipcodep);
-                } else if (key_pressed(KEY_X) && buf.readonly == false && buf.selection_origin != -1) {
-                    size_t start = buf.cursor;
-                    size_t end = buf.selection_origin;
-                    if (start > end) {
-                        start = buf.selection_origin;
-                        end = buf.cursor;
+                } else if (key_pressed(KEY_X) && buf.readonly == false && buf_get_selection(&buf, &start, &end)) {
+                    char* utf8string = buf_load_utf8(&buf, start, end);
+                    if (utf8string) {
+                        SetClipboardText(utf8string);
+                        free(utf8string);
+                        remove_selection(&buf);
                     }
-                    int clipboard[end-start];
-                    memcpy(clipboard, buf.content + start, sizeof(int)*(end-start));
-                    char* utf8string = LoadUTF8(clipboard, end-start);
-                    SetClipboardText(utf8string);
-                    UnloadUTF8(utf8string);
-                    remove_selection(&buf);
-                    update_newlines(&buf);
-                    color_highlight(&buf);
                 }
             }
+            if (buf.loader && buf.is_searching == SEARCHING_NONE && key_pressed(KEY_ESCAPE)) buf_load_cancel(&buf);
             if (buf.readonly) update_buf(&buf, false, true);
             else update_buf(&buf, false, false);
         } else if (state == STATE_OPEN) {
@@ -712,19 +589,18 @@ int main(int argc, char** argv) {
                         deinit_buf(&open_buffer);
                         init_open_buffer(&open_buffer);
                     } else {
-                        int* line = open_buffer.content + open_buffer.lines[l].start;
-                        size_t line_length = open_buffer.lines[l].end - open_buffer.lines[l].start;
-                        char* utf8_string = LoadUTF8(line, line_length);
-                        if (utf8_string[line_length-1] == '/') {
+                        Line line = buf_line(&open_buffer, l);
+                        char* utf8_string = buf_load_utf8(&open_buffer, line.start, line.end);
+                        if (utf8_string && text_get(&open_buffer.text, line.end - 1) == '/') {
                             ChangeDirectory(utf8_string);
                             deinit_buf(&open_buffer);
                             init_open_buffer(&open_buffer);
-                        } else {
+                        } else if (utf8_string) {
                             deinit_buf(&buf);
                             init_buf_from_file(&buf, utf8_string);
                             state = STATE_TEXT;
                         }
-                        UnloadUTF8(utf8_string);
+                        free(utf8_string);
                     }
                 }
             }
@@ -735,7 +611,7 @@ int main(int argc, char** argv) {
             if (key_pressed(KEY_ESCAPE)) {
                 state = STATE_TEXT;
             } else if (key_pressed(KEY_ENTER)) {
-                Line line = save_buffer.lines[l];
+                Line line = buf_line(&save_buffer, l);
                 if (l == 1) {
                     const char* cwd = GetWorkingDirectory();
                     size_t cwdl = strlen(cwd);
@@ -746,7 +622,7 @@ int main(int argc, char** argv) {
                         UnloadCodepoints(utfs);
                     } else {
                         int* str = malloc(strl*sizeof(int));
-                        memcpy(str + utfl + 1, save_buffer.content + line.start, sizeof(int)*(line.end-line.start));
+                        text_copy(&save_buffer.text, line.start, line.end, str + utfl + 1);
                         memcpy(str, utfs, utfl*sizeof(int));
                         str[utfl] = '/';
                         
@@ -754,6 +630,7 @@ int main(int argc, char** argv) {
                         buf.filename = str;
                         buf.filenamel = strl;
                         save_file(&buf);
+                        color_highlight(&buf);
                         state = STATE_TEXT;
                     }
                 } else if (l > 1) {
@@ -761,46 +638,34 @@ int main(int argc, char** argv) {
                         ChangeDirectory("..");
                         deinit_buf(&save_buffer);
                         init_save_buffer(&save_buffer);
-                    } else if (save_buffer.content[line.end - 1] == '/') {
-                        int str[line.end-line.start];
-                        memcpy(str, save_buffer.content + line.start, line.end-line.start);
-                        char* ustr = LoadUTF8(str, line.end-line.start);
-                        ChangeDirectory(ustr);
-                        UnloadUTF8(ustr);
-                        deinit_buf(&save_buffer);
-                        init_save_buffer(&save_buffer);
+                    } else if (text_get(&save_buffer.text, line.end - 1) == '/') {
+                        char* ustr = buf_load_utf8(&save_buffer, line.start, line.end);
+                        if (ustr) {
+                            ChangeDirectory(ustr);
+                            free(ustr);
+                            deinit_buf(&save_buffer);
+                            init_save_buffer(&save_buffer);
+                        }
                     }
                 }
             }
             if (l == 1) {
                 if (key_pressed(KEY_V) && save_buffer.readonly == false) {
-                    if (save_buffer.selection_origin != -1) {
+                    if (save_buffer.has_selection) {
                         remove_selection(&save_buffer);
                     }
                     const char* clipboard = GetClipboardText();
                     int cliplen;
                     int* clipcodep = LoadCodepoints(clipboard, &cliplen);
-                    for (int i = 0; i < cliplen; ++i) {
-                        push_at_cursor(&save_buffer, clipcodep[i]);
-                    }
-                    update_newlines(&save_buffer);
-                    color_highlight(&save_buffer);
+                    insert_range(&save_buffer, save_buffer.cursor, clipcodep, cliplen);
                     UnloadCodepoints(clipcodep);
-                } else if (key_pressed(KEY_X) && save_buffer.readonly == false && save_buffer.selection_origin != -1) {
-                    size_t start = save_buffer.cursor;
-                    size_t end = save_buffer.selection_origin;
-                    if (start > end) {
-                        start = save_buffer.selection_origin;
-                        end = save_buffer.cursor;
+                } else if (key_pressed(KEY_X) && save_buffer.readonly == false && buf_get_selection(&save_buffer, &start, &end)) {
+                    char* utf8string = buf_load_utf8(&save_buffer, start, end);
+                    if (utf8string) {
+                        SetClipboardText(utf8string);
+                        free(utf8string);
+                        remove_selection(&save_buffer);
                     }
-                    int clipboard[end-start];
-                    memcpy(clipboard, save_buffer.content + start, sizeof(int)*(end-start));
-                    char* utf8string = LoadUTF8(clipboard, end-start);
-                    SetClipboardText(utf8string);
-                    UnloadUTF8(utf8string);
-                    remove_selection(&save_buffer);
-                    update_newlines(&save_buffer);
-                    color_highlight(&save_buffer);
                 }
                 update_buf(&save_buffer, true, false);
             } update_buf(&save_buffer, true, true);
@@ -818,28 +683,26 @@ int main(int argc, char** argv) {
             posx = -cp + lines_size + pad;
         }
 
-        while (l > GetScreenHeight()/font_size*0.8+pos) {
-            pos += 1;
-        }
-        while (l < (size_t) pos) {
-            pos -= 1;
-        }
+        // Scroll just far enough to keep the cursor line in the top 80%.
+        double rows = GetScreenHeight()/font_size*0.8;
+        if (l > rows + pos) pos = l - (int) rows;
+        if (l < (size_t) pos) pos = l;
 
         BeginDrawing();
             ClearBackground(BACKGROUND);
             if (debug) DrawFPS(10, 10);
             if (state == STATE_TEXT) {
-                draw_buffer(&buf, font, font_size, pos, posx, lines_size, pad, false, inner_pad);
-                draw_statusbar(&buf, font, font_size);
+                draw_buffer(&buf, glyphs, font_size, pos, posx, lines_size, pad, false, inner_pad);
+                draw_statusbar(&buf, glyphs, font_size);
             } else if (state == STATE_OPEN) {
-                draw_buffer(&open_buffer, font, font_size, pos, posx, lines_size, pad, true, inner_pad);
-                draw_statusbar(&open_buffer, font, font_size);
+                draw_buffer(&open_buffer, glyphs, font_size, pos, posx, lines_size, pad, true, inner_pad);
+                draw_statusbar(&open_buffer, glyphs, font_size);
             } else if (state == STATE_SAVE) {
-                draw_buffer(&save_buffer, font, font_size, pos, posx, lines_size, pad, true, inner_pad);
-                draw_statusbar(&save_buffer, font, font_size);
+                draw_buffer(&save_buffer, glyphs, font_size, pos, posx, lines_size, pad, true, inner_pad);
+                draw_statusbar(&save_buffer, glyphs, font_size);
             } else if (state == STATE_HELP) {
-                draw_buffer(&help_buffer, font, font_size, pos, posx, lines_size, pad, false, inner_pad);
-                draw_statusbar(&help_buffer, font, font_size);
+                draw_buffer(&help_buffer, glyphs, font_size, pos, posx, lines_size, pad, false, inner_pad);
+                draw_statusbar(&help_buffer, glyphs, font_size);
             }
         EndDrawing();
     }
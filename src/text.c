@@ -0,0 +1,793 @@
+// Piece table text storage.
+//
+// The document is an immutable original buffer (the file as it was loaded)
+// plus an append-only add buffer that every insertion is copied into. The
+// text itself is the in-order concatenation of pieces pointing into those
+// buffers. Pieces live in the leaves of a B+-tree (a rope of chunks) that
+// caches the byte, codepoint and newline count of every subtree, so finding,
+// inserting and removing at an offset, and mapping an offset to a line and
+// back, all cost O(log n) instead of walking the whole file.
+//
+// Text is stored as UTF-8. Every offset in the API is still a codepoint
+// offset, pieces are only ever cut on codepoint boundaries, and a codepoint
+// is a lead byte followed by its continuation bytes, so malformed input
+// still has a well defined length.
+//
+// The original buffer can also be a read-only mapping of the file. Then it
+// is indexed lazily: only the first INDEXED bytes are in the tree, and
+// text_index pulls in more a budget at a time.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXT_SIMD
+#include <immintrin.h>
+#endif
+
+#define TEXT_FANOUT 32
+#define TEXT_BLOCK (64*1024)
+// Longest piece in bytes, bounds the scans done inside a single piece.
+#define TEXT_CHUNK 4096
+
+typedef struct {
+    size_t bytes;
+    size_t length;
+    size_t newlines;
+} TextStats;
+
+typedef struct TextNode {
+    bool leaf;
+    int count;
+    // Two spare slots so a leaf can take a split piece plus a new one
+    // before it is split itself.
+    TextStats stats[TEXT_FANOUT + 2];
+    union {
+        struct TextNode* children[TEXT_FANOUT + 2];
+        char* pieces[TEXT_FANOUT + 2];
+    };
+    struct TextNode* prev;
+    struct TextNode* next;
+} TextNode;
+
+typedef struct {
+    TextNode* root;
+    char* original;
+    size_t original_bytes;
+    size_t indexed;
+    bool mapped;
+    char* add;
+    size_t add_used;
+    char** blocks;
+    size_t length;
+    // Bumped by every change, lets callers tell whether anything changed.
+    size_t version;
+} Text;
+
+typedef struct {
+    TextNode* leaf;
+    int index;
+    size_t offset;
+    size_t skip;
+    size_t left;
+} TextIter;
+
+bool text_utf8_continuation(char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Byte offset of codepoint CP within N bytes of S.
+size_t text_utf8_offset(const char* s, size_t n, size_t cp) {
+    size_t i = 0;
+    while (i < n) {
+        if (!text_utf8_continuation(s[i])) {
+            if (cp == 0) return i;
+            cp--;
+        }
+        i++;
+    }
+    return n;
+}
+
+// Decodes the codepoint at S, no more than N bytes long, and stores its
+// size in SIZE. Malformed sequences decode to '?' like LoadCodepoints does.
+// Like everywhere else in here a codepoint is a byte and all the
+// continuation bytes after it, however many there are.
+int text_utf8_decode(const char* s, size_t n, int* size) {
+    unsigned char c = s[0];
+    int length = 1;
+    while ((size_t) length < n && text_utf8_continuation(s[length])) length++;
+    *size = length;
+    if (c < 0x80) return length == 1 ? c : '?';
+    int expected = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+    if (expected != length) return '?';
+    int cp = c & (0x7F >> length);
+    for (int i = 1; i < length; ++i) cp = (cp << 6) | (s[i] & 0x3F);
+    return cp;
+}
+
+int text_utf8_encode(int cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// Counting codepoints and newlines is the pass every loaded byte goes
+// through, so it has SSE2 and AVX2 versions picked at runtime. Codepoints
+// are the bytes that aren't continuation bytes, which as signed chars are
+// the ones from -64 up.
+TextStats text_stats_scalar(const char* data, size_t n) {
+    TextStats stats = {n, 0, 0};
+    for (size_t i = 0; i < n; ++i) {
+        stats.length += !text_utf8_continuation(data[i]);
+        stats.newlines += data[i] == '\n';
+    }
+    return stats;
+}
+
+#ifdef TEXT_SIMD
+__attribute__((target("sse2")))
+TextStats text_stats_sse2(const char* data, size_t n) {
+    TextStats stats = {n, 0, 0};
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i lead = _mm_set1_epi8(-65);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+        stats.newlines += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+        stats.length += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(v, lead)));
+    }
+    TextStats tail = text_stats_scalar(data + i, n - i);
+    stats.length += tail.length;
+    stats.newlines += tail.newlines;
+    return stats;
+}
+
+__attribute__((target("avx2,popcnt")))
+TextStats text_stats_avx2(const char* data, size_t n) {
+    TextStats stats = {n, 0, 0};
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i lead = _mm256_set1_epi8(-65);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+        stats.newlines += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+        stats.length += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, lead)));
+    }
+    TextStats tail = text_stats_scalar(data + i, n - i);
+    stats.length += tail.length;
+    stats.newlines += tail.newlines;
+    return stats;
+}
+#endif
+
+// Set once at startup by text_select_kernel, before any other thread runs.
+// Until then counting is done the scalar way.
+TextStats (*text_stats_kernel)(const char*, size_t) = text_stats_scalar;
+
+void text_select_kernel(void) {
+#ifdef TEXT_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) text_stats_kernel = text_stats_avx2;
+    else if (__builtin_cpu_supports("sse2")) text_stats_kernel = text_stats_sse2;
+#endif
+}
+
+TextStats text_stats(const char* data, size_t n) {
+    return text_stats_kernel(data, n);
+}
+
+// Number of codepoints in N bytes of S.
+size_t text_utf8_length(const char* s, size_t n) {
+    return text_stats(s, n).length;
+}
+
+size_t text_count_newlines(const char* data, size_t n) {
+    return text_stats(data, n).newlines;
+}
+
+void text_stats_add(TextStats* a, TextStats b) {
+    a->bytes += b.bytes;
+    a->length += b.length;
+    a->newlines += b.newlines;
+}
+
+TextNode* text_node_new(bool leaf) {
+    TextNode* node = calloc(1, sizeof(TextNode));
+    node->leaf = leaf;
+    return node;
+}
+
+TextStats text_node_total(TextNode* node) {
+    TextStats total = {0};
+    for (int i = 0; i < node->count; ++i) text_stats_add(&total, node->stats[i]);
+    return total;
+}
+
+TextNode* text_node_first_leaf(TextNode* node) {
+    while (!node->leaf) node = node->children[0];
+    return node;
+}
+
+TextNode* text_node_last_leaf(TextNode* node) {
+    while (!node->leaf) node = node->children[node->count-1];
+    return node;
+}
+
+void text_node_free(TextNode* node) {
+    if (!node->leaf) {
+        for (int i = 0; i < node->count; ++i) text_node_free(node->children[i]);
+    }
+    free(node);
+}
+
+// Frees a whole subtree, stitching the leaf list around it first.
+void text_node_drop(TextNode* node) {
+    TextNode* first = text_node_first_leaf(node);
+    TextNode* last = text_node_last_leaf(node);
+    if (first->prev) first->prev->next = last->next;
+    if (last->next) last->next->prev = first->prev;
+    text_node_free(node);
+}
+
+void text_node_insert_slot(TextNode* node, int i, TextStats stats, void* item) {
+    memmove(node->stats + i + 1, node->stats + i, (node->count - i)*sizeof(TextStats));
+    memmove(node->children + i + 1, node->children + i, (node->count - i)*sizeof(void*));
+    node->stats[i] = stats;
+    node->children[i] = item;
+    node->count++;
+}
+
+void text_node_remove_slot(TextNode* node, int i) {
+    memmove(node->stats + i, node->stats + i + 1, (node->count - i - 1)*sizeof(TextStats));
+    memmove(node->children + i, node->children + i + 1, (node->count - i - 1)*sizeof(void*));
+    node->count--;
+}
+
+TextNode* text_node_split(TextNode* node) {
+    TextNode* right = text_node_new(node->leaf);
+    int half = node->count / 2;
+    right->count = node->count - half;
+    memcpy(right->stats, node->stats + half, right->count*sizeof(TextStats));
+    memcpy(right->children, node->children + half, right->count*sizeof(void*));
+    node->count = half;
+    if (node->leaf) {
+        right->next = node->next;
+        right->prev = node;
+        if (node->next) node->next->prev = right;
+        node->next = right;
+    }
+    return right;
+}
+
+// Folds RIGHT into LEFT. Caller guarantees the slots fit.
+void text_node_merge(TextNode* left, TextNode* right) {
+    memcpy(left->stats + left->count, right->stats, right->count*sizeof(TextStats));
+    memcpy(left->children + left->count, right->children, right->count*sizeof(void*));
+    left->count += right->count;
+    if (left->leaf) {
+        left->next = right->next;
+        if (right->next) right->next->prev = left;
+    }
+    free(right);
+}
+
+void text_node_rebalance(TextNode* node) {
+    for (int i = 0; i + 1 < node->count;) {
+        TextNode* a = node->children[i];
+        TextNode* b = node->children[i+1];
+        if ((a->count < TEXT_FANOUT/2 || b->count < TEXT_FANOUT/2) && a->count + b->count <= TEXT_FANOUT) {
+            text_node_merge(a, b);
+            text_stats_add(&node->stats[i], node->stats[i+1]);
+            text_node_remove_slot(node, i+1);
+        } else i++;
+    }
+}
+
+// Inserts the run DATA (described by STATS) at codepoint POS inside the
+// subtree. Returns the new right sibling if the node had to split, 0
+// otherwise.
+TextNode* text_node_insert(TextNode* node, size_t pos, char* data, TextStats stats, bool can_extend) {
+    int i = 0;
+    if (node->leaf) {
+        while (i < node->count && pos > node->stats[i].length) { pos -= node->stats[i].length; i++; }
+        if (node->count == 0) {
+            text_node_insert_slot(node, 0, stats, data);
+        } else if (pos == 0) {
+            text_node_insert_slot(node, i, stats, data);
+        } else if (pos == node->stats[i].length) {
+            size_t bytes = node->stats[i].bytes;
+            if (can_extend && node->pieces[i] + bytes == data && bytes + stats.bytes <= TEXT_CHUNK) {
+                text_stats_add(&node->stats[i], stats);
+            } else text_node_insert_slot(node, i+1, stats, data);
+        } else {
+            char* piece = node->pieces[i];
+            size_t cut = text_utf8_offset(piece, node->stats[i].bytes, pos);
+            TextStats left = text_stats(piece, cut);
+            TextStats right = {
+                node->stats[i].bytes - cut,
+                node->stats[i].length - left.length,
+                node->stats[i].newlines - left.newlines,
+            };
+            text_node_insert_slot(node, i+1, right, piece + cut);
+            text_node_insert_slot(node, i+1, stats, data);
+            node->stats[i] = left;
+        }
+    } else {
+        while (i < node->count - 1 && pos > node->stats[i].length) { pos -= node->stats[i].length; i++; }
+        TextNode* split = text_node_insert(node->children[i], pos, data, stats, can_extend);
+        if (split) {
+            text_node_insert_slot(node, i+1, text_node_total(split), split);
+            node->stats[i] = text_node_total(node->children[i]);
+        } else text_stats_add(&node->stats[i], stats);
+    }
+    if (node->count > TEXT_FANOUT) return text_node_split(node);
+    return 0;
+}
+
+// Removes codepoints [START, END) from the subtree. Cutting out the middle
+// of a piece leaves two pieces, so this can split a node too.
+TextNode* text_node_delete(TextNode* node, size_t start, size_t end) {
+    size_t off = 0;
+    for (int i = 0; i < node->count && off < end;) {
+        size_t length = node->stats[i].length;
+        size_t ps = off, pe = off + length;
+        off = pe;
+        if (pe <= start) { i++; continue; }
+        size_t cs = (start > ps ? start : ps) - ps;
+        size_t ce = (end < pe ? end : pe) - ps;
+        if (cs == 0 && ce == length) {
+            if (!node->leaf) text_node_drop(node->children[i]);
+            text_node_remove_slot(node, i);
+            continue;
+        }
+        if (node->leaf) {
+            char* data = node->pieces[i];
+            size_t bytes = node->stats[i].bytes;
+            size_t bs = text_utf8_offset(data, bytes, cs);
+            size_t be = text_utf8_offset(data, bytes, ce);
+            if (cs == 0) {
+                node->pieces[i] += be;
+                node->stats[i] = text_stats(data + be, bytes - be);
+            } else if (ce == length) {
+                node->stats[i] = text_stats(data, bs);
+            } else {
+                text_node_insert_slot(node, i+1, text_stats(data + be, bytes - be), data + be);
+                node->stats[i] = text_stats(data, bs);
+                i++;
+            }
+        } else {
+            TextNode* split = text_node_delete(node->children[i], cs, ce);
+            node->stats[i] = text_node_total(node->children[i]);
+            if (split) {
+                text_node_insert_slot(node, i+1, text_node_total(split), split);
+                i++;
+            }
+        }
+        i++;
+    }
+    if (!node->leaf) text_node_rebalance(node);
+    if (node->count > TEXT_FANOUT) return text_node_split(node);
+    return 0;
+}
+
+void text_fix_root(Text* t, TextNode* split) {
+    if (split) {
+        TextNode* root = text_node_new(false);
+        text_node_insert_slot(root, 0, text_node_total(t->root), t->root);
+        text_node_insert_slot(root, 1, text_node_total(split), split);
+        t->root = root;
+    }
+    while (!t->root->leaf && t->root->count == 1) {
+        TextNode* child = t->root->children[0];
+        free(t->root);
+        t->root = child;
+    }
+    if (!t->root->leaf && t->root->count == 0) {
+        free(t->root);
+        t->root = text_node_new(true);
+    }
+}
+
+void text_init(Text* t) {
+    memset(t, 0, sizeof(Text));
+    t->root = text_node_new(true);
+    t->blocks = da_new(char*);
+}
+
+// Adds BYTES of UTF-8 at DATA to the end of the text as pieces. DATA has to
+// hold whole codepoints and outlive the text.
+void text_append(Text* t, char* data, size_t bytes) {
+    size_t at = 0;
+    while (at < bytes) {
+        size_t n = bytes - at < TEXT_CHUNK ? bytes - at : TEXT_CHUNK;
+        while (at + n < bytes && n > 1 && text_utf8_continuation(data[at + n])) n--;
+        TextStats stats = text_stats(data + at, n);
+        text_fix_root(t, text_node_insert(t->root, t->length, data + at, stats, false));
+        t->length += stats.length;
+        at += n;
+    }
+    if (bytes > 0) t->version++;
+}
+
+// Same as text_append, and the text takes ownership of the malloc'd BLOCK.
+void text_append_block(Text* t, char* block, size_t bytes) {
+    da_push(t->blocks, block);
+    text_append(t, block, bytes);
+}
+
+// Adds up to BUDGET more bytes of the original buffer to the end of the
+// tree. Returns true while part of the original is still left out.
+bool text_index(Text* t, size_t budget) {
+    size_t bytes = t->original_bytes;
+    size_t at = t->indexed;
+    if (at == bytes) return false;
+    size_t end = bytes - at < budget ? bytes : at + budget;
+    while (end < bytes && text_utf8_continuation(t->original[end])) end++;
+    text_append(t, t->original + at, end - at);
+    t->indexed = end;
+    return end < bytes;
+}
+
+// Takes ownership of the UTF-8 buffer ORIGINAL, which must come from malloc.
+void text_init_from(Text* t, char* original, size_t bytes) {
+    text_init(t);
+    t->original = original;
+    t->original_bytes = bytes;
+    text_index(t, bytes);
+}
+
+// Maps the file FNAME read-only as the original buffer without reading or
+// indexing any of it. Returns false if the file is smaller than MIN bytes,
+// or with errno set if mapping it isn't possible.
+bool text_init_mapped(Text* t, const char* fname, size_t min) {
+    text_init(t);
+#ifdef _WIN32
+    (void) fname;
+    (void) min;
+    errno = ENOSYS;
+    return false;
+#else
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0 || (size_t) st.st_size < min) {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    char* original = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (original == MAP_FAILED) return false;
+    madvise(original, st.st_size, MADV_SEQUENTIAL);
+    t->original = original;
+    t->original_bytes = st.st_size;
+    t->mapped = true;
+    return true;
+#endif
+}
+
+void text_free(Text* t) {
+    text_node_free(t->root);
+    for (size_t i = 0; i < da_length(t->blocks); ++i) free(t->blocks[i]);
+    da_free(t->blocks);
+#ifndef _WIN32
+    if (t->mapped) munmap(t->original, t->original_bytes);
+    else
+#endif
+    if (t->original) free(t->original);
+    memset(t, 0, sizeof(Text));
+}
+
+size_t text_length(Text* t) {
+    return t->length;
+}
+
+size_t text_bytes(Text* t) {
+    return text_node_total(t->root).bytes;
+}
+
+size_t text_lines(Text* t) {
+    return text_node_total(t->root).newlines + 1;
+}
+
+// Offset of the first codepoint of LINE, or the text length past the end.
+size_t text_line_start(Text* t, size_t line) {
+    if (line == 0) return 0;
+    TextNode* node = t->root;
+    size_t pos = 0;
+    int i = 0;
+    while (!node->leaf) {
+        i = 0;
+        while (i < node->count - 1 && line > node->stats[i].newlines) {
+            line -= node->stats[i].newlines;
+            pos += node->stats[i].length;
+            i++;
+        }
+        node = node->children[i];
+    }
+    for (i = 0; i < node->count; ++i) {
+        if (line > node->stats[i].newlines) {
+            line -= node->stats[i].newlines;
+            pos += node->stats[i].length;
+            continue;
+        }
+        char* data = node->pieces[i];
+        char* end = data + node->stats[i].bytes;
+        for (char* nl = data; (nl = memchr(nl, '\n', end - nl)); nl++) {
+            if (--line == 0) return pos + text_utf8_length(data, nl - data) + 1;
+        }
+    }
+    return t->length;
+}
+
+// Line that contains offset POS.
+size_t text_line_of(Text* t, size_t pos) {
+    TextNode* node = t->root;
+    size_t line = 0;
+    int i = 0;
+    while (!node->leaf) {
+        i = 0;
+        while (i < node->count - 1 && pos >= node->stats[i].length) {
+            pos -= node->stats[i].length;
+            line += node->stats[i].newlines;
+            i++;
+        }
+        node = node->children[i];
+    }
+    for (i = 0; i < node->count && pos > 0; ++i) {
+        if (pos >= node->stats[i].length) {
+            pos -= node->stats[i].length;
+            line += node->stats[i].newlines;
+        } else {
+            char* data = node->pieces[i];
+            line += text_count_newlines(data, text_utf8_offset(data, node->stats[i].bytes, pos));
+            pos = 0;
+        }
+    }
+    return line;
+}
+
+// Byte offset of codepoint POS.
+size_t text_byte_of(Text* t, size_t pos) {
+    if (pos >= t->length) return text_bytes(t);
+    TextNode* node = t->root;
+    size_t bytes = 0;
+    int i = 0;
+    while (!node->leaf) {
+        i = 0;
+        while (i < node->count - 1 && pos >= node->stats[i].length) {
+            pos -= node->stats[i].length;
+            bytes += node->stats[i].bytes;
+            i++;
+        }
+        node = node->children[i];
+    }
+    for (i = 0; i < node->count; ++i) {
+        if (pos < node->stats[i].length) {
+            return bytes + text_utf8_offset(node->pieces[i], node->stats[i].bytes, pos);
+        }
+        pos -= node->stats[i].length;
+        bytes += node->stats[i].bytes;
+    }
+    return bytes;
+}
+
+// Makes sure the add buffer has room for at least one more codepoint.
+void text_reserve(Text* t) {
+    if (t->add == 0 || t->add_used + 4 > TEXT_BLOCK) {
+        t->add = malloc(TEXT_BLOCK);
+        t->add_used = 0;
+        da_push(t->blocks, t->add);
+    }
+}
+
+void text_insert_piece(Text* t, size_t at, char* data, size_t bytes) {
+    TextStats stats = text_stats(data, bytes);
+    text_fix_root(t, text_node_insert(t->root, at, data, stats, data != t->add));
+    t->length += stats.length;
+    t->version++;
+}
+
+void text_insert(Text* t, size_t at, const int* codepoints, size_t n) {
+    if (at > t->length) at = t->length;
+    while (n > 0) {
+        text_reserve(t);
+        char* data = t->add + t->add_used;
+        size_t bytes = 0, taken = 0;
+        while (taken < n && bytes + 4 <= TEXT_CHUNK && t->add_used + bytes + 4 <= TEXT_BLOCK) {
+            bytes += text_utf8_encode(codepoints[taken++], data + bytes);
+        }
+        t->add_used += bytes;
+        text_insert_piece(t, at, data, bytes);
+        at += taken;
+        codepoints += taken;
+        n -= taken;
+    }
+}
+
+// Same as text_insert, for text that is already UTF-8.
+void text_insert_utf8(Text* t, size_t at, const char* s, size_t bytes) {
+    if (at > t->length) at = t->length;
+    while (bytes > 0) {
+        text_reserve(t);
+        size_t take = TEXT_BLOCK - t->add_used;
+        if (take > TEXT_CHUNK) take = TEXT_CHUNK;
+        if (take >= bytes) take = bytes;
+        else while (take > 1 && text_utf8_continuation(s[take])) take--;
+        char* data = t->add + t->add_used;
+        memcpy(data, s, take);
+        t->add_used += take;
+        size_t length = text_utf8_length(data, take);
+        text_insert_piece(t, at, data, take);
+        at += length;
+        s += take;
+        bytes -= take;
+    }
+}
+
+void text_delete(Text* t, size_t start, size_t end) {
+    if (end > t->length) end = t->length;
+    if (start >= end) return;
+    text_fix_root(t, text_node_delete(t->root, start, end));
+    t->length -= end - start;
+    t->version++;
+}
+
+// Positions IT on codepoints [START, END) of the text.
+void text_iter_init(Text* t, TextIter* it, size_t start, size_t end) {
+    if (end > t->length) end = t->length;
+    if (start > end) start = end;
+    TextNode* node = t->root;
+    size_t pos = start;
+    int i = 0;
+    while (!node->leaf) {
+        i = 0;
+        while (i < node->count - 1 && pos >= node->stats[i].length) { pos -= node->stats[i].length; i++; }
+        node = node->children[i];
+    }
+    i = 0;
+    while (i < node->count && pos >= node->stats[i].length) { pos -= node->stats[i].length; i++; }
+    it->leaf = node;
+    it->index = i;
+    it->skip = pos;
+    it->offset = i < node->count ? text_utf8_offset(node->pieces[i], node->stats[i].bytes, pos) : 0;
+    it->left = end - start;
+}
+
+// Yields the next contiguous run of UTF-8, false once the range is done.
+// LENGTH, if not null, receives the number of codepoints in the run.
+bool text_iter_next(TextIter* it, char** span, size_t* bytes, size_t* length) {
+    if (it->left == 0) return false;
+    while (it->index >= it->leaf->count) {
+        it->leaf = it->leaf->next;
+        it->index = 0;
+        it->offset = 0;
+        it->skip = 0;
+    }
+    TextStats stats = it->leaf->stats[it->index];
+    char* data = it->leaf->pieces[it->index] + it->offset;
+    size_t n = stats.length - it->skip;
+    size_t b = stats.bytes - it->offset;
+    if (n > it->left) {
+        n = it->left;
+        b = text_utf8_offset(data, b, n);
+    }
+    *span = data;
+    *bytes = b;
+    if (length) *length = n;
+    it->left -= n;
+    it->offset = 0;
+    it->skip = 0;
+    it->index++;
+    return true;
+}
+
+int text_get(Text* t, size_t i) {
+    if (i >= t->length) return 0;
+    TextIter it;
+    char* span;
+    size_t n;
+    int size;
+    text_iter_init(t, &it, i, i+1);
+    text_iter_next(&it, &span, &n, 0);
+    return text_utf8_decode(span, n, &size);
+}
+
+// Decodes codepoints [START, END) into OUT, returns how many were written.
+size_t text_copy(Text* t, size_t start, size_t end, int* out) {
+    TextIter it;
+    char* span;
+    size_t n, total = 0;
+    text_iter_init(t, &it, start, end);
+    while (text_iter_next(&it, &span, &n, 0)) {
+        for (size_t i = 0; i < n;) {
+            int size;
+            out[total++] = text_utf8_decode(span + i, n - i, &size);
+            i += size;
+        }
+    }
+    return total;
+}
+
+// Copies codepoints [START, END) as UTF-8 into OUT and terminates it. OUT
+// needs room for the bytes between text_byte_of START and END plus one.
+// Returns the byte count.
+size_t text_copy_utf8(Text* t, size_t start, size_t end, char* out) {
+    TextIter it;
+    char* span;
+    size_t n, total = 0;
+    text_iter_init(t, &it, start, end);
+    while (text_iter_next(&it, &span, &n, 0)) {
+        memcpy(out + total, span, n);
+        total += n;
+    }
+    out[total] = '\0';
+    return total;
+}
+
+bool text_match(Text* t, size_t at, const char* needle, size_t bytes) {
+    TextIter it;
+    char* span;
+    size_t n, i = 0;
+    text_iter_init(t, &it, at, t->length);
+    while (i < bytes && text_iter_next(&it, &span, &n, 0)) {
+        if (n > bytes - i) n = bytes - i;
+        if (memcmp(span, needle + i, n) != 0) return false;
+        i += n;
+    }
+    return i == bytes;
+}
+
+// Finds the first occurrence of the codepoints NEEDLE at or after FROM.
+bool text_find(Text* t, size_t from, const int* needle, size_t n, size_t* found) {
+    if (n == 0) return false;
+    char* uneedle = malloc(n*4);
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; ++i) bytes += text_utf8_encode(needle[i], uneedle + bytes);
+
+    TextIter it;
+    char* span;
+    size_t l, pos = from;
+    bool result = false;
+    text_iter_init(t, &it, from, t->length);
+    while (!result && text_iter_next(&it, &span, &l, 0)) {
+        for (size_t i = 0; i < l; ++i) {
+            if (text_utf8_continuation(span[i])) continue;
+            if (span[i] == uneedle[0] && text_match(t, pos, uneedle, bytes)) {
+                *found = pos;
+                result = true;
+                break;
+            }
+            pos++;
+        }
+    }
+    free(uneedle);
+    return result;
+}